@@ -0,0 +1,92 @@
+/**
+ * @file benchmark.h
+ * @brief Scripted camera paths and frame-time statistics for reproducible
+ * benchmark runs.
+ *
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <perf_counters.h>
+
+/**
+ * One keyframe of a camera path file. Each non-comment line holds
+ *
+ *   time mouseX mouseY mouseControl frontView topView
+ *
+ * with time in seconds on the benchmark clock, the cursor normalized to
+ * [0, 1] over the render target, and the view toggles as 0 or 1. The cursor
+ * is interpolated linearly between keyframes; toggles hold until the next
+ * keyframe.
+ */
+struct CameraKey {
+  double time = 0.0;
+  float mouseX = 0.5f;
+  float mouseY = 0.5f;
+  bool mouseControl = true;
+  bool frontView = false;
+  bool topView = false;
+};
+
+class CameraPath {
+public:
+  bool load(const std::string &file);
+  bool empty() const { return keys.empty(); }
+  CameraKey sample(double time) const;
+
+private:
+  std::vector<CameraKey> keys;
+};
+
+class BenchmarkRecorder {
+public:
+  // Leading frames left out of the statistics; they include lazy shader
+  // compilation and texture loading.
+  int warmupFrames = 0;
+
+  void recordGpuFrame(const std::map<std::string, double> &passTimes);
+  // Per-frame values of a named group of counters, e.g. GPU work counters
+  // or GL call counts.
+  void recordCounters(const std::string &group,
+                      const std::map<std::string, double> &counters);
+  void recordCpuFrame(double ms);
+  // Per-frame hardware counters of each thread. Call before recordCpuFrame().
+  void recordCpuCounters(const std::vector<ThreadPerfCounters> &threads);
+  // Cumulative energy in joules (EnergyCounter::joules()) at the end of the
+  // frame. Call before recordCpuFrame().
+  void recordEnergy(double joules);
+
+  // Extra top level fields, e.g. renderer or resolution.
+  void setInfo(const std::string &key, const std::string &value);
+  void setInfo(const std::string &key, double value);
+
+  // Writes mean/p50/p95/p99/max per pass (GPU), for the GPU frame total and
+  // for the CPU frame time, all in milliseconds, and the same statistics
+  // for every recorded counter. Hardware counters are
+  // summarized per thread as per-frame averages, IPC and miss rates, and
+  // energy as joules per frame and average watts.
+  bool writeJson(const std::string &file) const;
+
+private:
+  std::map<std::string, std::vector<double>> gpuPasses;
+  std::map<std::string, std::map<std::string, std::vector<double>>>
+      counterGroups;
+  std::map<std::string, int> counterGroupFramesSeen;
+  std::vector<double> gpuFrames;
+  std::vector<double> cpuFrames;
+  std::map<std::string, PerfCounterValues> cpuCounters;
+  std::map<std::string, int> cpuCounterFrames;
+  double energyStart = -1.0;
+  double energyEnd = 0.0;
+  int energyFrames = 0;
+  std::map<std::string, std::string> info;
+  int gpuFramesSeen = 0;
+  int cpuFramesSeen = 0;
+};
+
+#endif /* BENCHMARK_H */
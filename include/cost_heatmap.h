@@ -0,0 +1,37 @@
+/**
+ * @file cost_heatmap.h
+ * @brief Per-frame totals of the per-pixel work that blackhole_main.frag
+ * writes in its debugCostView mode.
+ *
+ */
+
+#ifndef COST_HEATMAP_H
+#define COST_HEATMAP_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+class CostReduction {
+public:
+  ~CostReduction();
+
+  // Sums every row of the cost texture into a 1 x height column the
+  // reduction owns, and queues an asynchronous readback of that column; the
+  // result of the previous call is collected at the same time, so totals()
+  // lags one frame behind. The cost texture itself is only read.
+  void reduce(GLuint costTexture, int height);
+
+  // Integration steps, adiskColor() calls and noise octaves summed over all
+  // pixels of the last collected frame.
+  const glm::dvec3 &totals() const { return frameTotals; }
+
+private:
+  GLuint rowSums = 0;
+  int rowSumsHeight = 0;
+  GLuint readbackBuffers[2] = {0, 0};
+  int readbackRows[2] = {0, 0};
+  int readbackIndex = 0;
+  glm::dvec3 frameTotals = glm::dvec3(0.0);
+};
+
+#endif /* COST_HEATMAP_H */
@@ -0,0 +1,55 @@
+/**
+ * @file dynamic_resolution.h
+ * @brief Frame-time driven controller for the black hole render scale, ray
+ * march step count and bloom iterations.
+ *
+ */
+
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+struct DynamicResolutionSettings {
+  float targetFrameMs = 16.6f;
+  float minRenderScale = 0.35f;
+  float maxRenderScale = 1.0f;
+  int minSteps = 120;
+  int maxSteps = 300;
+  int minBloomIterations = 3;
+  int maxBloomIterations = 8;
+};
+
+class DynamicResolution {
+public:
+  DynamicResolutionSettings settings;
+
+  /**
+   * Feeds the GPU time of the last resolved frame. The controller keeps a
+   * single quality level in [0, 1] that all knobs are derived from, drops it
+   * quickly when over budget (e.g. the camera dives into the disk) and raises
+   * it slowly when there is headroom, with a small dead band to avoid
+   * oscillating around the target.
+   *
+   * Every render size change reallocates the render targets, so the render
+   * scale only takes RENDER_SCALE_STEPS discrete values and moves to another
+   * one once the quality level is well past the midpoint between them.
+   */
+  void update(double gpuFrameMs);
+
+  void reset() {
+    quality = 1.0f;
+    scaleStep = RENDER_SCALE_STEPS - 1;
+  }
+
+  float qualityLevel() const { return quality; }
+  float renderScale() const;
+  int stepCount() const;
+  int bloomIterations() const;
+
+private:
+  static const int RENDER_SCALE_STEPS = 6;
+
+  float quality = 1.0f;
+  int scaleStep = RENDER_SCALE_STEPS - 1;
+};
+
+#endif /* DYNAMIC_RESOLUTION_H */
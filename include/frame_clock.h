@@ -0,0 +1,24 @@
+/**
+ * @file frame_clock.h
+ * @brief Time source for the shaders' `time` uniform. Defaults to
+ * glfwGetTime(); benchmarks switch to a fixed step per frame so every run
+ * renders exactly the same frames.
+ *
+ */
+
+#ifndef FRAME_CLOCK_H
+#define FRAME_CLOCK_H
+
+double getFrameTime();
+
+// Replace wall-clock time with a clock that starts at 0 and only advances by
+// timeStep on each advanceFrameClock() call.
+void useFixedStepClock(double timeStep);
+void advanceFrameClock();
+
+// Freezes getFrameTime(). After resuming, the clock continues from where it
+// stopped instead of jumping ahead. May be called from any thread.
+void setFrameClockPaused(bool paused);
+bool isFrameClockPaused();
+
+#endif /* FRAME_CLOCK_H */
@@ -0,0 +1,120 @@
+/**
+ * @file frame_pacer.h
+ * @brief Swap interval control and just-in-time frame starts for low
+ * input latency.
+ *
+ * Instead of starting a frame as soon as the previous one was submitted and
+ * letting it wait for vblank (or the cap) with stale input, the pacer waits
+ * until the GPU finished the previous frame, predicts how long the next one
+ * will take from recent frames, and sleeps until just before the point where
+ * it has to start to make its deadline. The camera input is sampled after
+ * that, as late as possible (latchInput()).
+ *
+ * Input-to-photon latency is measured with a GL_TIMESTAMP query after the
+ * last draw of each frame, read back without stalling a few frames later,
+ * and converted to the CPU clock. With vsync the photons leave at the first
+ * vblank after the GPU is done; the vblank grid is estimated from the times
+ * glfwSwapBuffers() returns, so the figure excludes scan-out and display
+ * lag.
+ *
+ */
+
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <string>
+
+#include <GL/glew.h>
+
+enum class PacingMode {
+  VSYNC,          // Swap interval 1.
+  ADAPTIVE_VSYNC, // Swap interval -1: tears instead of halving the rate.
+  CAPPED,         // No vsync, frames paced to settings.capFps.
+  UNCAPPED,       // No vsync and no pacing, as fast as possible.
+};
+
+const char *pacingModeName(PacingMode mode);
+bool parsePacingMode(const std::string &name, PacingMode &mode);
+
+struct FramePacerSettings {
+  PacingMode mode = PacingMode::VSYNC;
+  float capFps = 60.0f;
+  // Slack left before the deadline for misprediction.
+  float marginMs = 1.5f;
+};
+
+class FramePacer {
+public:
+  FramePacerSettings settings;
+
+  // refreshRate of the window's monitor in Hz. Without `presenting`
+  // (headless) the swap interval is left alone and the vsync modes pace to
+  // refreshRate like CAPPED.
+  FramePacer(double refreshRate, bool presenting);
+  ~FramePacer();
+
+  FramePacer(const FramePacer &) = delete;
+  FramePacer &operator=(const FramePacer &) = delete;
+
+  // Render thread with the context current, first thing in a frame: applies
+  // the mode, collects finished measurements, waits for the previous frame
+  // and sleeps until the predicted start time.
+  void beginFrame();
+
+  // Right after sampling the input the frame is rendered with.
+  void latchInput();
+
+  // After the last draw call of the frame, before swapping.
+  void endRendering();
+
+  // After glfwSwapBuffers() returned.
+  void endFrame();
+
+  // Smoothed input-to-photon latency, 0 until measured.
+  double latencyMs() const { return latency * 1000.0; }
+  // Expected time from frame start to GPU done.
+  double predictedFrameMs() const { return predictedWork * 1000.0; }
+  bool adaptiveSupported() const { return tearControl; }
+
+private:
+  static const int FRAMES = 4;
+  static const int WORK_HISTORY = 16;
+
+  struct Frame {
+    GLuint query = 0;
+    bool pending = false;
+    double start = 0.0;    // After the pacing sleep.
+    double latched = 0.0;  // Input sample time.
+    double deadline = 0.0; // Target vblank, 0 without vsync.
+  };
+
+  void applySwapInterval();
+  void calibrate();
+  void resolve();
+  double period() const;
+  bool vsyncMode() const;
+
+  const double refreshRate;
+  const bool presenting;
+  bool tearControl = false;
+  bool timestamps = false;
+  int appliedInterval = -2; // Not applied yet.
+
+  Frame frames[FRAMES];
+  int frameIndex = 0;
+  GLsync previousFence = 0;
+
+  // CPU clock minus GPU clock, in seconds.
+  double clockOffset = 0.0;
+  double lastCalibration = -1.0;
+
+  double work[WORK_HISTORY] = {};
+  int workIndex = 0;
+  double predictedWork = 0.0;
+  double latency = 0.0;
+
+  double lastSwap = 0.0;     // Anchor of the vblank grid.
+  double nextDeadline = 0.0; // Of the frame being rendered.
+};
+
+#endif /* FRAME_PACER_H */
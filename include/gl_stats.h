@@ -0,0 +1,122 @@
+/**
+ * @file gl_stats.h
+ * @brief Per-frame counts of GL calls that cost driver time.
+ *
+ * Include after <GL/glew.h> in a translation unit to count its framebuffer,
+ * program and texture binds, uniform location lookups, uniform uploads,
+ * clears and draws. Each counted function is replaced by an inline wrapper
+ * that bumps a counter before forwarding to GL. Without GL_CALL_STATS (CMake
+ * option, on by default) the header leaves GL untouched. Render thread only.
+ *
+ */
+
+#ifndef GL_STATS_H
+#define GL_STATS_H
+
+#include <utility>
+#include <vector>
+
+#include <GL/glew.h>
+
+struct GlCallStats {
+  int framebufferBinds = 0;
+  int programBinds = 0;
+  int textureBinds = 0;
+  int uniformLookups = 0;
+  int uniformUploads = 0;
+  int clears = 0;
+  int draws = 0;
+};
+
+extern GlCallStats glCallStats;
+
+// Returns the counts since the previous call and starts a new frame.
+GlCallStats endGlStatsFrame();
+// Counts of the frame last ended by endGlStatsFrame().
+const GlCallStats &previousGlStatsFrame();
+bool glCallStatsEnabled();
+
+// Name/count pairs in declaration order, for reports.
+std::vector<std::pair<const char *, int>> glCallStatsFields(const GlCallStats &stats);
+
+#ifdef GL_CALL_STATS
+
+static inline void glStatsBindFramebuffer(GLenum target, GLuint framebuffer) {
+  glCallStats.framebufferBinds++;
+  glBindFramebuffer(target, framebuffer);
+}
+
+static inline void glStatsUseProgram(GLuint program) {
+  glCallStats.programBinds++;
+  glUseProgram(program);
+}
+
+static inline void glStatsBindTexture(GLenum target, GLuint texture) {
+  glCallStats.textureBinds++;
+  glBindTexture(target, texture);
+}
+
+static inline GLint glStatsGetUniformLocation(GLuint program,
+                                              const GLchar *name) {
+  glCallStats.uniformLookups++;
+  return glGetUniformLocation(program, name);
+}
+
+static inline void glStatsUniform1f(GLint location, GLfloat v0) {
+  glCallStats.uniformUploads++;
+  glUniform1f(location, v0);
+}
+
+static inline void glStatsUniform2f(GLint location, GLfloat v0, GLfloat v1) {
+  glCallStats.uniformUploads++;
+  glUniform2f(location, v0, v1);
+}
+
+static inline void glStatsUniform1i(GLint location, GLint v0) {
+  glCallStats.uniformUploads++;
+  glUniform1i(location, v0);
+}
+
+static inline void glStatsClear(GLbitfield mask) {
+  glCallStats.clears++;
+  glClear(mask);
+}
+
+static inline void glStatsDrawArrays(GLenum mode, GLint first,
+                                     GLsizei count) {
+  glCallStats.draws++;
+  glDrawArrays(mode, first, count);
+}
+
+static inline void glStatsDrawArraysInstanced(GLenum mode, GLint first,
+                                              GLsizei count,
+                                              GLsizei instances) {
+  glCallStats.draws++;
+  glDrawArraysInstanced(mode, first, count, instances);
+}
+
+#undef glBindFramebuffer
+#undef glUseProgram
+#undef glBindTexture
+#undef glGetUniformLocation
+#undef glUniform1f
+#undef glUniform2f
+#undef glUniform1i
+#undef glClear
+#undef glDrawArrays
+#undef glDrawArraysInstanced
+
+#define glBindFramebuffer glStatsBindFramebuffer
+#define glUseProgram glStatsUseProgram
+#define glBindTexture glStatsBindTexture
+#define glGetUniformLocation glStatsGetUniformLocation
+#define glUniform1f glStatsUniform1f
+#define glUniform2f glStatsUniform2f
+#define glUniform1i glStatsUniform1i
+#define glClear glStatsClear
+#define glDrawArrays glStatsDrawArrays
+#define glDrawArraysInstanced glStatsDrawArraysInstanced
+
+#endif /* GL_CALL_STATS */
+
+#endif /* GL_STATS_H */
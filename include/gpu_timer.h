@@ -0,0 +1,85 @@
+/**
+ * @file gpu_timer.h
+ * @brief Non-blocking GPU pass timing with GL_TIME_ELAPSED queries.
+ *
+ * Queries issued in frame N are read back FRAME_LATENCY frames later, by
+ * which time the GPU has normally finished them, so the CPU never waits on a
+ * result. Results that are still not available are dropped.
+ *
+ */
+
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <GL/glew.h>
+
+class GpuTimer {
+public:
+  static const int FRAME_LATENCY = 4;
+
+  // Wait for late results instead of dropping them. Benchmarks use this so
+  // that every frame is accounted for.
+  bool blocking = false;
+
+  // Called with the per-pass times of every frame as it is resolved.
+  std::function<void(const std::map<std::string, double> &passTimes)>
+      onFrameResolved;
+
+  ~GpuTimer();
+
+  // Call once per frame before any begin(). Collects the results of the
+  // frame issued FRAME_LATENCY frames ago.
+  void beginFrame();
+
+  // Time the GPU work submitted between begin() and end(). Scopes must not
+  // nest; passes sharing a name within a frame are summed.
+  void begin(const std::string &name);
+  void end();
+
+  // Blocks until every outstanding frame is resolved.
+  void finish();
+
+  // Append "frame,pass,ms" rows for every resolved frame to a CSV file.
+  bool openCsvLog(const std::string &file);
+
+  // Latest resolved GPU time in milliseconds for name, 0 if unknown.
+  double elapsedMs(const std::string &name) const;
+
+  // Latest resolved per-pass times, and their sum.
+  const std::map<std::string, double> &passTimes() const { return results; }
+  // Same as passTimes(), in submission order.
+  const std::vector<std::pair<std::string, double>> &orderedPassTimes() const {
+    return orderedResults;
+  }
+  double frameMs() const { return totalMs; }
+
+private:
+  struct Query {
+    std::string name;
+    GLuint id;
+  };
+
+  GLuint acquireQuery();
+  void resolveFrame(int index);
+
+  std::vector<Query> frames[FRAME_LATENCY];
+  std::vector<GLuint> freeQueries;
+  int frameIndex = 0;
+  bool active = false;
+
+  std::map<std::string, double> results;
+  std::vector<std::pair<std::string, double>> orderedResults;
+  double totalMs = 0.0;
+
+  std::ofstream csvLog;
+  uint64_t resolvedFrames = 0;
+};
+
+#endif /* GPU_TIMER_H */
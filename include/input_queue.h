@@ -0,0 +1,127 @@
+/**
+ * @file input_queue.h
+ * @brief Window input forwarded from the GLFW event thread to the render
+ * thread.
+ *
+ * GLFW delivers events, and only lets most window functions be called, on
+ * the main thread, while the render thread owns the GL context and ImGui.
+ * attach() installs GLFW callbacks on the main thread that push every event
+ * into a lock-free SpscQueue; the render thread drains it once per frame
+ * with dispatch() and feeds ImGui from the result instead of calling
+ * ImGui_ImplGlfw_NewFrame() or the backend's callbacks, which would query
+ * the window from the wrong thread. Keys are translated to ImGuiKey in the
+ * callback, on the main thread. ImGui must be initialized with
+ * install_callbacks = false.
+ *
+ * Headless runs keep everything on one thread: the same thread then calls
+ * glfwPollEvents() and dispatch().
+ *
+ */
+
+#ifndef INPUT_QUEUE_H
+#define INPUT_QUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+#include <spsc_queue.h>
+
+struct GLFWwindow;
+
+struct InputEvent {
+  enum Type {
+    CURSOR_POS,
+    MOUSE_BUTTON,
+    SCROLL,
+    KEY,
+    CHAR,
+    WINDOW_SIZE,
+    FRAMEBUFFER_SIZE,
+    FOCUS,
+    CLOSE,
+  };
+  Type type = CURSOR_POS;
+  // Key (ImGuiKey) or button, native key, action, mods, or a size, or a
+  // codepoint.
+  int a = 0, b = 0, c = 0, d = 0;
+  double x = 0.0, y = 0.0; // Cursor position or scroll offsets.
+};
+
+// Render side view of the window, as of the last dispatch().
+struct InputState {
+  double cursorX = 0.0, cursorY = 0.0;
+  int windowWidth = 0, windowHeight = 0;
+  int framebufferWidth = 0, framebufferHeight = 0;
+  bool focused = true;
+  bool closeRequested = false;
+  static const int MOUSE_BUTTONS = 5;
+  bool mouseDown[MOUSE_BUTTONS] = {};
+  // Pressed since the last frame, so clicks shorter than a frame count.
+  bool mousePressed[MOUSE_BUTTONS] = {};
+};
+
+class InputQueue {
+public:
+  // Main thread, after ImGui is initialized: routes the window's callbacks
+  // into this queue and queues its current size. The queue must outlive the
+  // window callbacks.
+  void attach(GLFWwindow *window);
+
+  // Render thread: applies all queued events to state() and hands
+  // keyboard and scroll input to ImGui without touching GLFW. Returns the
+  // number of events.
+  int dispatch();
+
+  // Render thread: blocks until an event is queued or `timeout` seconds
+  // passed. Used to idle when there is nothing new to render.
+  void waitForEvents(double timeout);
+
+  // Render thread: sets up ImGui's display size, time step and mouse for
+  // the next ImGui::NewFrame(), like ImGui_ImplGlfw_NewFrame() does.
+  void newImGuiFrame();
+
+  const InputState &state() const { return inputState; }
+
+  // Any thread: the newest cursor position, possibly ahead of the events
+  // dispatched so far. Used to late-latch the camera.
+  void latestCursor(float &x, float &y) const;
+
+  // Events dropped because the render thread fell CAPACITY events behind.
+  int droppedEvents() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+  static const size_t CAPACITY = 4096;
+
+  void push(const InputEvent &event);
+
+  static void cursorPosCallback(GLFWwindow *window, double x, double y);
+  static void mouseButtonCallback(GLFWwindow *window, int button, int action,
+                                  int mods);
+  static void scrollCallback(GLFWwindow *window, double x, double y);
+  static void keyCallback(GLFWwindow *window, int key, int scancode,
+                          int action, int mods);
+  static void charCallback(GLFWwindow *window, unsigned int codepoint);
+  static void windowSizeCallback(GLFWwindow *window, int width, int height);
+  static void framebufferSizeCallback(GLFWwindow *window, int width,
+                                      int height);
+  static void focusCallback(GLFWwindow *window, int focused);
+  static void closeCallback(GLFWwindow *window);
+
+  SpscQueue<InputEvent, CAPACITY> events;
+  GLFWwindow *window = nullptr;
+  std::atomic<int> dropped{0};
+  std::atomic<uint64_t> cursor{0}; // Two packed floats, so x and y match.
+
+  // Wakes waitForEvents(). Only touched while the render thread sleeps.
+  std::atomic<bool> waiting{false};
+  std::mutex waitMutex;
+  std::condition_variable waitCondition;
+
+  // Render side.
+  InputState inputState;
+  double lastFrameTime = 0.0;
+};
+
+#endif /* INPUT_QUEUE_H */
@@ -0,0 +1,83 @@
+/**
+ * @file job_system.h
+ * @brief Work-stealing thread pool shared by all CPU-side work.
+ *
+ * A fixed number of workers each own a deque: jobs submitted from a worker
+ * go to its own deque and are popped LIFO, idle workers steal FIFO from the
+ * others. Jobs submitted from other threads are spread round-robin. Workers
+ * with nothing to run or steal sleep on a condition variable, so an idle
+ * pool uses no CPU. Threads waiting for a JobGroup run pending jobs in the
+ * meantime instead of blocking.
+ *
+ */
+
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Completion counter for a set of jobs.
+struct JobGroup {
+  std::atomic<int> pending{0};
+
+  bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+class JobSystem {
+public:
+  // 0 workers means one per hardware thread, minus one for the render thread.
+  explicit JobSystem(int workerCount = 0);
+  ~JobSystem();
+
+  JobSystem(const JobSystem &) = delete;
+  JobSystem &operator=(const JobSystem &) = delete;
+
+  int workerCount() const { return (int)workers.size(); }
+
+  // Queues a job. If group is given, it counts the job until it finished.
+  void submit(std::function<void()> job, JobGroup *group = nullptr);
+
+  // Runs queued jobs on the calling thread until all jobs of group finished.
+  void wait(JobGroup &group);
+
+  // Calls body(begin, end) over [0, count) in chunks of at most grainSize,
+  // spread over the workers and the calling thread. Returns when done.
+  void parallelFor(int count, int grainSize,
+                   const std::function<void(int begin, int end)> &body);
+
+private:
+  struct Job {
+    std::function<void()> function;
+    JobGroup *group = nullptr;
+  };
+
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Job> jobs;
+    std::thread thread;
+  };
+
+  void workerThreadFunc(int index);
+  bool popOrSteal(int index, Job &job);
+  void run(Job &job);
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::atomic<int> queuedJobs{0};
+  std::atomic<unsigned> nextWorker{0};
+
+  std::mutex sleepMutex;
+  std::condition_variable sleepCondition;
+  bool stopping = false;
+};
+
+// Process wide pool, created on first use.
+JobSystem &jobSystem();
+
+#endif /* JOB_SYSTEM_H */
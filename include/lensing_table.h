@@ -0,0 +1,59 @@
+/**
+ * @file lensing_table.h
+ * @brief Precomputed inverse lensing map used to splat particles at their
+ * lensed image positions.
+ *
+ * Schwarzschild lensing is symmetric around the camera-hole axis, so the
+ * image of a point depends on three numbers only: the camera distance, the
+ * source radius r and the angle psi at the hole between camera and source.
+ * For every such triple the table holds, for the primary image and for the
+ * secondary image on the far side of the hole, the angle between the image
+ * and the direction to the hole as seen from the camera, plus the
+ * magnification. It is traced with the same null geodesic equation as
+ * blackhole_main.frag (u'' + u = 1.5 u^2 with the horizon at r = 1), and
+ * built on the job system in the background.
+ *
+ */
+
+#ifndef LENSING_TABLE_H
+#define LENSING_TABLE_H
+
+#include <vector>
+
+#include <GL/glew.h>
+
+#include <job_system.h>
+
+class LensingTable {
+public:
+  // Texture layout: x = psi over [0, pi], y = source radius, z = camera
+  // distance. RGBA = primary angle, primary magnification, secondary angle,
+  // secondary magnification. Angles are negative where there is no image.
+  static const int PSI_SIZE = 256;
+  static const int RADIUS_SIZE = 128;
+  static const int CAMERA_SIZE = 16;
+  static constexpr float MIN_RADIUS = 1.5f;
+  static constexpr float MAX_RADIUS = 24.0f;
+  static constexpr float MIN_CAMERA_DISTANCE = 10.0f;
+  static constexpr float MAX_CAMERA_DISTANCE = 30.0f;
+
+  ~LensingTable();
+
+  // Queues the computation on the job system and returns immediately.
+  void build();
+  bool isBuilding() const { return building; }
+
+  // Render thread: the 3D texture, uploaded on the first call after the
+  // build finished. 0 until then.
+  GLuint texture();
+
+private:
+  void buildSlice(int cameraIndex);
+
+  std::vector<float> table;
+  JobGroup group;
+  bool building = false;
+  GLuint tableTexture = 0;
+};
+
+#endif /* LENSING_TABLE_H */
@@ -0,0 +1,75 @@
+/**
+ * @file particle_renderer.h
+ * @brief Draws the simulated disk particles as additive points.
+ *
+ * Snapshots are copied into a persistently mapped vertex buffer split into
+ * three regions, so the CPU writes one region while the GPU may still read
+ * the others; a fence per region guards reuse. The copy is spread over the
+ * job system. Without GL_ARB_buffer_storage (GL 4.4) the buffer is orphaned
+ * and refilled with glBufferSubData() instead.
+ *
+ * The vertex layout is structure-of-arrays like the simulation: one float
+ * attribute per position and velocity component. Between snapshots the
+ * vertex shader extrapolates along the velocity. Given a LensingTable
+ * texture, every particle is drawn twice with instancing, at its primary and
+ * at its secondary image, so the cost scales with the particle count and not
+ * with the pixel count.
+ *
+ */
+
+#ifndef PARTICLE_RENDERER_H
+#define PARTICLE_RENDERER_H
+
+#include <map>
+#include <string>
+
+#include <GL/glew.h>
+
+struct ParticleSnapshot;
+
+class ParticleRenderer {
+public:
+  ParticleRenderer();
+  ~ParticleRenderer();
+
+  ParticleRenderer(const ParticleRenderer &) = delete;
+  ParticleRenderer &operator=(const ParticleRenderer &) = delete;
+
+  void upload(const ParticleSnapshot &snapshot);
+
+  // Adds the last uploaded particles to targetTexture, positioned for
+  // `time`. The camera uniforms are the black hole pass' floatUniforms;
+  // entries particles.vert does not use are ignored. Without lensingTable
+  // the particles are drawn unlensed.
+  void render(GLuint targetTexture, int width, int height, double time,
+              const std::map<std::string, float> &floatUniforms,
+              GLuint colorMap, GLuint lensingTable = 0);
+
+  int particleCount() const { return count; }
+  // Simulation time of the last uploaded snapshot.
+  double uploadedTime() const { return snapshotTime; }
+  bool isPersistent() const { return persistent; }
+
+private:
+  static const int REGIONS = 3;
+  static const int ATTRIBUTES = 6;
+
+  void allocate(int capacity);
+  bool waitForRegion(int region);
+  GLint uniformLocation(const std::string &name);
+
+  GLuint program = 0;
+  GLuint vao = 0;
+  GLuint buffer = 0;
+  bool persistent = false;
+  char *mapped = nullptr;
+  GLsync fences[REGIONS] = {};
+  std::map<std::string, GLint> uniformLocations;
+
+  int capacity = 0; // Particles per region.
+  int region = 0;   // Region holding the last upload.
+  int count = 0;
+  double snapshotTime = 0.0;
+};
+
+#endif /* PARTICLE_RENDERER_H */
@@ -0,0 +1,58 @@
+/**
+ * @file perf_counters.h
+ * @brief Per-thread hardware performance counters (Linux perf_event_open).
+ *
+ * Threads that do CPU-side work call registerPerfCounterThread() once; the
+ * render thread calls samplePerfCounters() once per frame to turn the running
+ * totals into per-frame deltas. Counters are opt-in (enablePerfCounters())
+ * and count user space only. Everything is a no-op where perf events are not
+ * available, including non-Linux builds.
+ *
+ */
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct PerfCounterValues {
+  uint64_t cycles = 0;
+  uint64_t instructions = 0;
+  uint64_t cacheReferences = 0;
+  uint64_t cacheMisses = 0;
+  uint64_t branches = 0;
+  uint64_t branchMisses = 0;
+
+  double ipc() const {
+    return cycles ? (double)instructions / (double)cycles : 0.0;
+  }
+  double cacheMissRate() const {
+    return cacheReferences ? (double)cacheMisses / (double)cacheReferences
+                           : 0.0;
+  }
+  double branchMissRate() const {
+    return branches ? (double)branchMisses / (double)branches : 0.0;
+  }
+
+  PerfCounterValues &operator+=(const PerfCounterValues &other);
+};
+
+struct ThreadPerfCounters {
+  std::string name;
+  PerfCounterValues frame; // Delta over the last samplePerfCounters() call.
+};
+
+// Must be called before any thread registers. Returns false if hardware
+// counters cannot be opened (no PMU, perf_event_paranoid, non-Linux).
+bool enablePerfCounters();
+bool perfCountersEnabled();
+
+// Starts counting the calling thread, listed as `name`.
+void registerPerfCounterThread(const std::string &name);
+
+void samplePerfCounters();
+std::vector<ThreadPerfCounters> perfCounterSnapshot();
+
+#endif /* PERF_COUNTERS_H */
@@ -0,0 +1,71 @@
+/**
+ * @file quality_tuner.h
+ * @brief Benchmarks the quality knobs on the current machine and derives
+ * low/medium/high/ultra presets that fit a frame-time target.
+ *
+ */
+
+#ifndef QUALITY_TUNER_H
+#define QUALITY_TUNER_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+struct QualitySettings {
+  float renderScale = 1.0f;
+  int steps = 300;
+  float adiskNoiseLOD = 5.0f;
+  int bloomIterations = 8;
+};
+
+// Preset names from cheapest to most expensive.
+extern const char *const QUALITY_PRESET_NAMES[4];
+
+bool loadQualityPresets(const std::string &file,
+                        std::map<std::string, QualitySettings> &presets);
+bool saveQualityPresets(const std::string &file,
+                        const std::map<std::string, QualitySettings> &presets);
+
+/**
+ * Runs over several frames: every candidate value of each knob is rendered
+ * for a few warm-up frames (enough for the GPU timer queries to catch up)
+ * and then measured, with all other knobs at their most expensive value.
+ * The costs are combined with a multiplicative model to predict every
+ * combination, and each preset takes the highest-quality combination that
+ * fits its share of the target frame time.
+ */
+class QualityTuner {
+public:
+  void start(float targetFrameMs);
+  bool isRunning() const { return running; }
+
+  // Settings the current frame must be rendered with while running.
+  const QualitySettings &currentSettings() const;
+
+  // Feeds the latest resolved GPU frame time. Returns true on the frame the
+  // sweep finishes and presets() becomes valid.
+  bool update(double gpuFrameMs);
+
+  float progress() const;
+  const std::map<std::string, QualitySettings> &presets() const {
+    return result;
+  }
+
+private:
+  static const int WARMUP_FRAMES = 6;
+  static const int MEASURE_FRAMES = 8;
+
+  void buildPresets();
+
+  bool running = false;
+  float targetMs = 16.6f;
+  std::vector<QualitySettings> candidates;
+  std::vector<double> candidateMs;
+  std::vector<double> samples;
+  int candidateIndex = 0;
+  int frameInCandidate = 0;
+  std::map<std::string, QualitySettings> result;
+};
+
+#endif /* QUALITY_TUNER_H */
@@ -13,13 +13,18 @@
 #ifndef RENDER_H
 #define RENDER_H
 
+#include <cstdint>
 #include <map>
 #include <string>
 #include <vector>
 
 #include <GL/glew.h>
 
-GLuint createColorTexture(int width, int height, bool hdr = true);
+class GpuTimer;
+
+// format is a sized color-renderable internal format, e.g. GL_RGB16F,
+// GL_R11F_G11F_B10F or GL_RGBA8.
+GLuint createColorTexture(int width, int height, GLenum format = GL_RGB16F);
 
 struct FramebufferCreateInfo {
   GLuint colorTexture = 0;
@@ -33,6 +38,8 @@ GLuint createFramebuffer(const FramebufferCreateInfo &info);
 GLuint createQuadVAO();
 
 struct RenderToTextureInfo {
+  // Label for GPU timing; defaults to the fragment shader file name.
+  std::string name;
   std::string vertexShader = "shader/simple.vert";
   std::string fragShader;
   std::map<std::string, float> floatUniforms;
@@ -41,8 +48,55 @@ struct RenderToTextureInfo {
   GLuint targetTexture;
   int width;
   int height;
+  // Hash of anything else the pass result depends on, see below.
+  uint64_t externalInputs = 0;
+};
+
+// Returns false if the draw was skipped because targetTexture already holds
+// the result of the same inputs.
+bool renderToTexture(const RenderToTextureInfo &rtti);
+
+/**
+ * Pass memoization. Each renderToTexture() call hashes its inputs: program,
+ * size, float uniforms, externalInputs, the frame time if the shader reads
+ * `time` without an override, and for every input texture the hash of the
+ * pass that last wrote it (or its name for textures that no pass writes).
+ * The hash becomes the content hash of the target, so a change propagates
+ * down the pass chain: the passes downstream of it redraw, and passes whose
+ * inputs are unchanged are skipped.
+ *
+ * Code that writes a texture some other way must call markTextureModified()
+ * or fold its own inputs into externalInputs of the pass it draws on top
+ * of.
+ */
+void setPassMemoization(bool enabled);
+void markTextureModified(GLuint texture);
+
+struct PassMemoStats {
+  int rendered = 0;
+  int skipped = 0;
+  // Input hashes of all passes, drawn or not. Equal on two frames when
+  // they show the same image, even if aliased targets had to be redrawn.
+  uint64_t frameHash = 0;
 };
 
-void renderToTexture(const RenderToTextureInfo &rtti);
+// Counts since the last call.
+PassMemoStats takePassMemoStats();
+
+// FNV-1a, chained through seed.
+uint64_t hashBytes(const void *data, size_t size,
+                   uint64_t seed = 14695981039346656037ull);
+
+// Wrap every renderToTexture() draw in a GPU timer scope. Pass nullptr to
+// stop timing.
+void setRenderToTextureTimer(GpuTimer *timer);
+
+// Returns the framebuffer with colorTexture attached, creating and caching it
+// on first use. renderToTexture() uses the same cache.
+GLuint getTextureFramebuffer(GLuint colorTexture);
+
+// Deletes the framebuffer renderToTexture() created for colorTexture, if any.
+// Call this before deleting or reallocating a render target texture.
+void releaseFramebuffer(GLuint colorTexture);
 
 #endif /* RENDER_H */
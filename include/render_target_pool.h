@@ -0,0 +1,95 @@
+/**
+ * @file render_target_pool.h
+ * @brief Named color render targets that follow the framebuffer size, and
+ * transient targets that alias each other within a frame.
+ *
+ */
+
+#ifndef RENDER_TARGET_POOL_H
+#define RENDER_TARGET_POOL_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+class RenderTargetPool {
+public:
+  ~RenderTargetPool();
+
+  /**
+   * Returns the color texture registered under name. The texture is created on
+   * first use and reallocated whenever the requested size or format differs
+   * from the existing one; the framebuffer renderToTexture() cached for the
+   * old texture is released along with it. See createColorTexture() for
+   * format.
+   */
+  GLuint get(const std::string &name, int width, int height,
+             GLenum format = GL_RGB16F);
+
+  void release(const std::string &name);
+  void releaseAll();
+
+  /**
+   * Transient targets, for intermediate results that are dead once their
+   * last reader has been submitted. A target's lifetime runs from
+   * acquireTransient() to releaseTransient(); storage released earlier in
+   * the frame is handed out again, so targets whose lifetimes do not
+   * overlap share memory. GL has no placement of textures in memory, so
+   * sharing needs the same size and either the same format or, with
+   * GL_ARB_texture_view, a format of the same texel size (e.g.
+   * GL_R11F_G11F_B10F and GL_RGBA8), which is then handed out as a view of
+   * the storage. The hand-out order is deterministic, and every frame with
+   * the same pass sequence maps each target to the same texture.
+   *
+   * Anything not released by endTransientFrame() is released there.
+   * Storage unused for a few frames, e.g. after a resize, is deleted.
+   */
+  GLuint acquireTransient(int width, int height, GLenum format = GL_RGB16F);
+  void releaseTransient(GLuint texture);
+  void endTransientFrame();
+
+  struct TransientStats {
+    size_t allocatedBytes = 0; // Resident transient storage.
+    size_t unaliasedBytes = 0; // What separate targets would have used.
+    int acquired = 0;
+    int textures = 0; // Storage allocations, views not counted.
+  };
+  // Of the last finished frame.
+  const TransientStats &transientStats() const { return lastFrameStats; }
+
+  // Approximate VRAM used by all targets in the pool, in bytes.
+  size_t memoryUsage() const;
+
+private:
+  struct Target {
+    GLuint texture = 0;
+    int width = 0;
+    int height = 0;
+    GLenum format = GL_RGB16F;
+  };
+
+  struct TransientTarget {
+    Target target; // The storage, viewed in its own format.
+    std::map<GLenum, GLuint> views; // The storage in other formats.
+    bool inUse = false;
+    int lastUsedFrame = 0;
+  };
+
+  static const int TRANSIENT_KEEP_FRAMES = 3;
+
+  static void destroy(const Target &target);
+  static void destroy(const TransientTarget &transient);
+  static size_t targetBytes(const Target &target);
+  GLuint transientTexture(TransientTarget &transient, GLenum format);
+
+  std::map<std::string, Target> targets;
+
+  std::vector<TransientTarget> transients;
+  int frame = 0;
+  TransientStats frameStats;
+  TransientStats lastFrameStats;
+};
+
+#endif /* RENDER_TARGET_POOL_H */
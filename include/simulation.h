@@ -0,0 +1,109 @@
+/**
+ * @file simulation.h
+ * @brief CPU-side scene simulation handed to the renderer through a
+ * TripleBuffer.
+ *
+ * The simulation ticks at a fixed rate, either on its own thread (start()) or
+ * inline from the render thread (advanceTo(), used by benchmarks so every run
+ * is deterministic). Each tick publishes a complete SimulationState; the
+ * render thread never blocks on the simulation and blends the two most recent
+ * snapshots, so the tick rate is independent of the display rate. Disk
+ * particles are published the same way, in their own, much larger, buffer.
+ *
+ */
+
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <glm/glm.hpp>
+
+#include <disk_particles.h>
+#include <triple_buffer.h>
+
+struct SimulationState {
+  double time = 0.0; // Frame clock time of this snapshot, seconds.
+  // Position of the automatic orbit camera.
+  glm::vec3 cameraOrbit = glm::vec3(0.0f);
+  // How far the disk noise has been advected. The integral of adiskSpeed,
+  // so changing the speed does not make the disk jump.
+  float adiskPhase = 0.0f;
+};
+
+// t = 0 gives a, t = 1 gives b.
+SimulationState interpolate(const SimulationState &a, const SimulationState &b,
+                            float t);
+
+class Simulation {
+public:
+  explicit Simulation(double tickRate = 60.0);
+  ~Simulation();
+
+  Simulation(const Simulation &) = delete;
+  Simulation &operator=(const Simulation &) = delete;
+
+  // Restarts the simulation at `time`. Not while the thread is running.
+  void reset(double time);
+
+  // Ticks on a dedicated thread, following getFrameTime().
+  void start();
+  void stop();
+
+  // Ticks on the calling thread until the next tick would pass `time`.
+  void advanceTo(double time);
+
+  // Inputs, may be changed from any thread.
+  void setDiskSpeed(float speed) {
+    diskSpeed.store(speed, std::memory_order_relaxed);
+  }
+  // 0 stops the particle simulation. Changing either value reseeds the disk.
+  void setParticles(int count, bool relativistic) {
+    particleCount.store(count, std::memory_order_relaxed);
+    particlesRelativistic.store(relativistic, std::memory_order_relaxed);
+  }
+
+  // Render thread: the state at `time`, blended from the latest snapshots.
+  // Lags one tick behind so that there are always two snapshots to blend.
+  SimulationState sample(double time);
+
+  // Render thread: returns true if new particles were published since the
+  // last call, then particles() holds them.
+  bool updateParticles() { return particleSnapshots.update(); }
+  const ParticleSnapshot &particles() const {
+    return particleSnapshots.readBuffer();
+  }
+
+  double tickInterval() const { return interval; }
+
+private:
+  void simulationThreadFunc();
+  void tick();
+  void tickParticles();
+
+  const double interval;
+  std::atomic<float> diskSpeed{0.5f};
+  std::atomic<int> particleCount{0};
+  std::atomic<bool> particlesRelativistic{true};
+
+  TripleBuffer<SimulationState> snapshots;
+  TripleBuffer<ParticleSnapshot> particleSnapshots;
+
+  // Simulation side.
+  SimulationState state;
+  DiskParticles diskParticles;
+  bool seededRelativistic = true;
+  std::thread simulationThread;
+  std::mutex stopMutex;
+  std::condition_variable stopCondition;
+  bool stopRequested = false;
+
+  // Render side.
+  SimulationState previous;
+  SimulationState current;
+};
+
+#endif /* SIMULATION_H */
@@ -0,0 +1,58 @@
+/**
+ * @file spsc_queue.h
+ * @brief Lock-free bounded FIFO between one producer and one consumer thread.
+ *
+ * A ring of CAPACITY slots indexed by two monotonically increasing counters:
+ * the producer only writes `tail`, the consumer only writes `head`, so
+ * neither side ever blocks or takes a lock. push() fails instead of waiting
+ * when the ring is full.
+ *
+ */
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+template <typename T, size_t CAPACITY> class SpscQueue {
+  static_assert((CAPACITY & (CAPACITY - 1)) == 0,
+                "SpscQueue capacity must be a power of two");
+
+public:
+  // Producer side. Returns false if the queue is full.
+  bool push(const T &value) {
+    const size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == CAPACITY) {
+      return false;
+    }
+    slots[t & (CAPACITY - 1)] = value;
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side.
+  bool empty() const {
+    return head.load(std::memory_order_relaxed) ==
+           tail.load(std::memory_order_acquire);
+  }
+
+  // Consumer side. Returns false if the queue is empty.
+  bool pop(T &value) {
+    const size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = slots[h & (CAPACITY - 1)];
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  T slots[CAPACITY] = {};
+  // On separate cache lines so the two threads do not false share.
+  alignas(64) std::atomic<size_t> head{0};
+  alignas(64) std::atomic<size_t> tail{0};
+};
+
+#endif /* SPSC_QUEUE_H */
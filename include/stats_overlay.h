@@ -1,5 +1,18 @@
 #pragma once
 
+class GpuTimer;
+class GpuWorkCounters;
+
 // Call this every frame (after starting a new ImGui frame)
-// to display the overlay with updated stats.
-void RenderStatsOverlay();
\ No newline at end of file
+// to display the overlay with updated stats. When a GPU timer
+// is given, its latest per-pass times are listed as well, and
+// likewise the shader work counters.
+void RenderStatsOverlay(const GpuTimer* gpuTimer = nullptr,
+                        const GpuWorkCounters* workCounters = nullptr);
+
+// Call once per frame with the CPU time of the frame and the latest
+// resolved GPU frame time. Feeds the frame time plot and percentiles.
+void RecordFrameTimes(float cpuMs, float gpuMs);
+
+// Writes the frame time ring (oldest first) as CSV. Returns false on failure.
+bool DumpFrameTimes(const char* file);
\ No newline at end of file
@@ -0,0 +1,95 @@
+/**
+ * @file telemetry.h
+ * @brief Background sampling of process, system and GPU statistics.
+ *
+ * Everything that can block (NVML, the nvidia-smi fallback, /proc and sysfs
+ * reads) runs on a dedicated thread. Snapshots are handed to the render
+ * thread through a TripleBuffer, so reading them never waits.
+ *
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <triple_buffer.h>
+
+// Values that could not be read are -1.
+struct TelemetrySnapshot {
+  int systemRamUsedMB = -1;
+  int processRssMB = -1;
+  int processPeakRssMB = -1;
+  int processThreads = -1;
+  float processCpuPercent = -1.0f; // Of one core, over the last interval.
+  int cpuTemperature = -1;         // Hottest thermal zone, degrees Celsius.
+  int gpuUsagePercent = -1;
+  int gpuTemperature = -1;
+  float powerWatts = -1.0f; // RAPL, over the last interval.
+};
+
+/**
+ * Energy from the RAPL counters under /sys/class/powercap/intel-rapl:*.
+ * Uses the platform ("psys") domain when there is one, otherwise the sum of
+ * all CPU packages. Sub-domains (cores, uncore, dram) are part of their
+ * package and are not added again. On most kernels energy_uj is readable by
+ * root only.
+ */
+class EnergyCounter {
+public:
+  // Returns false if no readable domain was found.
+  bool open();
+  bool isOpen() const { return !domains.empty(); }
+
+  // Joules consumed since open(). Counter wrap-around is handled using
+  // max_energy_range_uj, as long as this is called at least once per wrap
+  // period (minutes to hours depending on load).
+  double joules();
+
+private:
+  struct Domain {
+    std::string energyFile;
+    uint64_t maxRange = 0;
+    uint64_t last = 0;
+  };
+  std::vector<Domain> domains;
+  double total = 0.0;
+};
+
+class TelemetryCollector {
+public:
+  ~TelemetryCollector();
+
+  void start(double intervalSeconds = 1.0);
+  void stop();
+
+  // Latest published snapshot. Render thread only.
+  const TelemetrySnapshot &latest();
+
+private:
+  void samplerThreadFunc();
+  void sample(TelemetrySnapshot &snapshot);
+
+  TripleBuffer<TelemetrySnapshot> snapshots;
+
+  std::thread samplerThread;
+  std::mutex stopMutex;
+  std::condition_variable stopCondition;
+  bool stopRequested = false;
+  double interval = 1.0;
+
+  // Sampler thread state.
+  double lastCpuSeconds = -1.0;
+  double lastWallSeconds = 0.0;
+  EnergyCounter energy;
+  double lastJoules = 0.0;
+  bool nvmlAvailable = false;
+  bool smiAvailable = true;
+};
+
+#endif /* TELEMETRY_H */
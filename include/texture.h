@@ -17,6 +17,10 @@
 
 GLuint loadTexture2D(const std::string &file, bool repeat = true);
 
-GLuint loadCubemap(const std::string &cubemapDir);
+// Loads right/left/top/bottom/front/back faces from cubemapDir. Radiance .hdr
+// faces are used when present and stored as hdrFormat (GL_RGB9_E5 or
+// GL_R11F_G11F_B10F); otherwise 8-bit PNG faces are loaded into GL_SRGB.
+GLuint loadCubemap(const std::string &cubemapDir,
+                   GLenum hdrFormat = GL_RGB9_E5);
 
 #endif /* TEXTURE_H */
@@ -0,0 +1,49 @@
+/**
+ * @file triple_buffer.h
+ * @brief Lock-free single-writer/single-reader exchange of the latest value.
+ *
+ * The writer fills writeBuffer() and calls publish(); the reader calls
+ * update() and then reads readBuffer(). Neither side ever blocks or waits on
+ * the other: the three slots are rotated through a single atomic index that
+ * also carries a "new data" bit. Intermediate values may be skipped, the
+ * reader always sees the most recently published one.
+ *
+ */
+
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+template <typename T> class TripleBuffer {
+public:
+  // Writer side.
+  T &writeBuffer() { return buffers[writeIndex]; }
+  void publish() {
+    writeIndex =
+        middle.exchange(writeIndex | DIRTY, std::memory_order_acq_rel) & INDEX;
+  }
+
+  // Reader side. Returns true if a new value was published since the last
+  // call.
+  bool update() {
+    if (!(middle.load(std::memory_order_relaxed) & DIRTY)) {
+      return false;
+    }
+    readIndex = middle.exchange(readIndex, std::memory_order_acq_rel) & INDEX;
+    return true;
+  }
+  const T &readBuffer() const { return buffers[readIndex]; }
+
+private:
+  static const uint8_t INDEX = 3;
+  static const uint8_t DIRTY = 4;
+
+  T buffers[3] = {};
+  std::atomic<uint8_t> middle{1};
+  uint8_t writeIndex = 0;
+  uint8_t readIndex = 2;
+};
+
+#endif /* TRIPLE_BUFFER_H */
@@ -0,0 +1,130 @@
+/**
+ * @file virtual_texture.h
+ * @brief Sparse virtual texturing for very large equirectangular panoramas.
+ *
+ * The panorama is stored on disk as a mip pyramid of fixed-size tiles (see
+ * buildVirtualTextureFile()). At runtime only the tiles requested by the
+ * feedback pass are streamed into a fixed-size physical atlas, so VRAM use is
+ * independent of the source image size. A page table texture (one mip level
+ * per pyramid level) maps every virtual tile to its atlas slot, or to the
+ * closest resident ancestor while the tile is still loading.
+ *
+ */
+
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include <render.h>
+
+/**
+ * Converts an equirectangular image (PNG/JPG/HDR via stb_image, power-of-two
+ * dimensions) into a tiled virtual texture file. Returns false on failure.
+ */
+bool buildVirtualTextureFile(const std::string &imageFile,
+                             const std::string &vtFile, int tileSize = 128);
+
+class VirtualTexture {
+public:
+  /**
+   * Opens a tiled file produced by buildVirtualTextureFile(). The physical
+   * atlas holds cacheTilesPerSide^2 tiles; a value of 32 with 128px tiles is
+   * roughly 52 MB regardless of the panorama resolution.
+   */
+  explicit VirtualTexture(const std::string &vtFile,
+                          int cacheTilesPerSide = 32);
+  ~VirtualTexture();
+
+  VirtualTexture(const VirtualTexture &) = delete;
+  VirtualTexture &operator=(const VirtualTexture &) = delete;
+
+  bool isValid() const { return valid; }
+
+  // Adds the page table, atlas and layout uniforms used by
+  // virtualPanoramaColor() in blackhole_main.frag.
+  void setUniforms(RenderToTextureInfo &rtti) const;
+
+  // Queues an asynchronous readback of the feedback target and processes the
+  // readback queued on the previous call. The feedback texture stores
+  // (tileX, tileY, level + 1) per pixel, zero meaning "no request".
+  void processFeedback(GLuint feedbackTexture, int width, int height);
+
+  // Uploads tiles finished by the streaming thread (at most
+  // maxUploadsPerFrame) and refreshes the page table if residency changed.
+  void update(int maxUploadsPerFrame = 16);
+
+  int residentTileCount() const { return (int)residentTiles.size(); }
+
+private:
+  struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t tileSize;
+    uint32_t border;
+    uint32_t levels;
+  };
+
+  struct LoadedTile {
+    uint64_t key;
+    std::vector<unsigned char> texels;
+  };
+
+  struct ResidentTile {
+    int slot;
+    uint64_t lastUsedFrame;
+  };
+
+  static uint64_t tileKey(int level, int x, int y);
+  int tilesX(int level) const;
+  int tilesY(int level) const;
+  size_t tileBytes() const;
+  std::streamoff tileOffset(int level, int x, int y) const;
+
+  bool readTile(std::ifstream &ifs, uint64_t key,
+                std::vector<unsigned char> &texels) const;
+  void streamingThreadFunc();
+  void requestTile(uint64_t key);
+  void uploadTile(const LoadedTile &tile);
+  void rebuildPageTable();
+
+  bool valid = false;
+  std::string file;
+  Header header = {};
+  int physicalTilesPerSide = 0;
+  std::vector<std::streamoff> levelOffsets;
+
+  GLuint pageTableTexture = 0;
+  GLuint physicalTexture = 0;
+  GLuint readbackBuffers[2] = {0, 0};
+  int readbackSizes[2][2] = {{0, 0}, {0, 0}};
+  int readbackIndex = 0;
+
+  uint64_t frame = 0;
+  std::unordered_map<uint64_t, ResidentTile> residentTiles;
+  std::vector<uint64_t> slotOwners; // tile key per atlas slot, ~0 when free
+  std::unordered_set<uint64_t> pendingTiles;
+  bool pageTableDirty = true;
+
+  std::thread streamingThread;
+  std::mutex queueMutex;
+  std::condition_variable queueCondition;
+  std::deque<uint64_t> requestQueue;
+  std::deque<LoadedTile> completedQueue;
+  bool stopStreaming = false;
+};
+
+#endif /* VIRTUAL_TEXTURE_H */
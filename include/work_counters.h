@@ -0,0 +1,73 @@
+/**
+ * @file work_counters.h
+ * @brief Hardware independent GPU work metrics counted by the shaders.
+ *
+ * blackhole_main.frag and the bloom shaders add their per-pixel work to a
+ * shader storage buffer with atomicAdd() when the workCounters uniform is
+ * set. Buffers rotate through a small ring and are read back once their
+ * fence has signaled, a few frames later, so the CPU never waits on the GPU.
+ * Needs GL_ARB_shader_storage_buffer_object (GL 4.3).
+ *
+ */
+
+#ifndef WORK_COUNTERS_H
+#define WORK_COUNTERS_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+
+#include <GL/glew.h>
+
+class GpuWorkCounters {
+public:
+  // Same order as the WorkCounters block in the shaders.
+  enum Counter {
+    STEPS,
+    DISK_SAMPLES,
+    CAPTURED_RAYS,
+    ESCAPED_RAYS,
+    BLOOM_SAMPLES,
+    COUNTER_COUNT
+  };
+  static const char *const COUNTER_NAMES[COUNTER_COUNT];
+
+  static const int RING_SIZE = 3;
+
+  // Wait for a ring slot instead of skipping the frame when the GPU is more
+  // than RING_SIZE frames behind. Benchmarks use this so that every frame is
+  // counted.
+  bool blocking = false;
+
+  // Called with the counters of every frame as it is read back.
+  std::function<void(const std::map<std::string, double> &counters)>
+      onFrameResolved;
+
+  ~GpuWorkCounters();
+
+  static bool isSupported();
+
+  // Clears the next ring buffer and binds it to storage block binding 0.
+  // Returns false if no buffer is free this frame, in which case the shaders
+  // must not count.
+  bool beginFrame();
+  // Fences the frame's buffer and collects any finished frames.
+  void endFrame();
+  // Blocks until every outstanding frame is read back.
+  void finish();
+
+  // Counters of the most recently read back frame.
+  const uint32_t *latest() const { return results; }
+
+private:
+  bool collect(int slot, bool wait);
+
+  GLuint buffers[RING_SIZE] = {};
+  GLsync fences[RING_SIZE] = {};
+  int current = 0;
+  bool counting = false;
+  uint32_t results[COUNTER_COUNT] = {};
+};
+
+#endif /* WORK_COUNTERS_H */
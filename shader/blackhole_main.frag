@@ -1,4 +1,5 @@
 #version 330 core
+#extension GL_ARB_shader_storage_buffer_object : enable
 
 const float PI = 3.14159265359;
 const float EPSILON = 0.0001;
@@ -17,11 +18,18 @@ uniform sampler2D colorMap;
 uniform float frontView = 0.0;
 uniform float topView = 0.0;
 uniform float cameraRoll = 0.0;
+// Automatic orbit camera, advanced by the CPU simulation.
+uniform float cameraOrbitX = 15.0;
+uniform float cameraOrbitY = 0.0;
+uniform float cameraOrbitZ = 0.0;
 
 uniform float gravatationalLensing = 1.0;
 uniform float renderBlackHole = 1.0;
 uniform float mouseControl = 0.0;
 uniform float fovScale = 1.0;
+// Number of integration steps. The step size grows as the count drops so the
+// ray still covers the same distance.
+uniform float maxSteps = 300.0;
 
 uniform float adiskEnabled = 1.0;
 uniform float adiskParticle = 1.0;
@@ -31,7 +39,44 @@ uniform float adiskDensityV = 1.0;
 uniform float adiskDensityH = 1.0;
 uniform float adiskNoiseScale = 1.0;
 uniform float adiskNoiseLOD = 5.0;
-uniform float adiskSpeed = 0.5;
+// Noise advection so far: adiskSpeed integrated over time by the simulation.
+uniform float adiskPhase = 0.0;
+
+// Sparse virtual texture holding an equirectangular sky panorama. The page
+// table has one mip level per pyramid level; each texel stores the atlas
+// slot (xy) and the pyramid level (z) of the tile that is resident for it.
+uniform float panoramaEnabled = 0.0;
+uniform sampler2D vtPageTable;
+uniform sampler2D vtPhysical;
+uniform float vtWidth = 1.0;
+uniform float vtHeight = 1.0;
+uniform float vtLevels = 1.0;
+uniform float vtTileSize = 128.0;
+uniform float vtBorder = 1.0;
+uniform float vtPhysicalTiles = 1.0;
+// When set, output tile requests (tileX, tileY, level + 1) instead of color.
+uniform float vtFeedback = 0.0;
+uniform float vtLodBias = 0.0;
+// When set, output the work done for the pixel instead of color: integration
+// steps, adiskColor() calls and noise octaves (see cost_heatmap.frag).
+uniform float debugCostView = 0.0;
+
+vec3 pixelCost = vec3(0.0);
+
+// Work counters, see work_counters.h. Counted only when countWork is set.
+uniform float countWork = 0.0;
+#ifdef GL_ARB_shader_storage_buffer_object
+layout(std430) buffer WorkCounters {
+  uint steps;
+  uint diskSamples;
+  uint capturedRays;
+  uint escapedRays;
+  uint bloomSamples;
+};
+#endif
+
+float rayDiskSamples = 0.0;
+bool rayCaptured = false;
 
 struct Ring {
   vec3 center;
@@ -140,9 +185,53 @@ float ringDistance(vec3 rayOrigin, vec3 rayDir, Ring ring) {
   }
 }
 
+vec2 panoramaUV(vec3 dir) {
+  dir = normalize(dir);
+  return vec2(0.5 - atan(dir.z, dir.x) / PI * 0.5, 0.5 - asin(dir.y) / PI);
+}
+
 vec3 panoramaColor(sampler2D tex, vec3 dir) {
-  vec2 uv = vec2(0.5 - atan(dir.z, dir.x) / PI * 0.5, 0.5 - asin(dir.y) / PI);
-  return texture2D(tex, uv).rgb;
+  return texture2D(tex, panoramaUV(dir)).rgb;
+}
+
+// Pick the pyramid level by comparing the angular size of a screen pixel with
+// the angular size of a level-0 texel. Screen-space derivatives are not usable
+// here because the ray march exits in non-uniform control flow.
+int vtMipLevel() {
+  float pixelAngle = fovScale / resolution.y;
+  float texelAngle = 2.0 * PI / vtWidth;
+  float lod = log2(pixelAngle / texelAngle) + vtLodBias;
+  return int(clamp(lod + 0.5, 0.0, vtLevels - 1.0));
+}
+
+vec2 vtLevelSize(float level) {
+  return max(vec2(vtWidth, vtHeight) / exp2(level), vec2(1.0));
+}
+
+ivec2 vtTile(vec2 uv, int level) {
+  ivec2 tile = ivec2(uv * vtLevelSize(float(level)) / vtTileSize);
+  return clamp(tile, ivec2(0), textureSize(vtPageTable, level) - 1);
+}
+
+vec3 virtualPanoramaRequest(vec3 dir) {
+  int level = vtMipLevel();
+  return vec3(vtTile(panoramaUV(dir), level), float(level + 1));
+}
+
+vec3 virtualPanoramaColor(vec3 dir) {
+  vec2 uv = panoramaUV(dir);
+  int level = vtMipLevel();
+  vec4 entry = texelFetch(vtPageTable, vtTile(uv, level), level) * 255.0;
+
+  // The entry may point at an ancestor tile while the requested one streams
+  // in, so address the atlas using the level that is actually resident.
+  vec2 texel = uv * vtLevelSize(entry.z);
+  vec2 inTile = texel - floor(texel / vtTileSize) * vtTileSize;
+  float physicalTileSize = vtTileSize + 2.0 * vtBorder;
+  vec2 atlasTexel = floor(entry.xy + 0.5) * physicalTileSize + vtBorder + inTile;
+  return textureLod(vtPhysical, atlasTexel / (vtPhysicalTiles * physicalTileSize),
+                    0.0)
+      .rgb;
 }
 
 vec3 accel(float h2, vec3 pos) {
@@ -258,6 +347,8 @@ mat3 lookAt(vec3 origin, vec3 target, float roll) {
 float sqrLength(vec3 a) { return dot(a, a); }
 
 void adiskColor(vec3 pos, inout vec3 color, inout float alpha) {
+  pixelCost.g += 1.0;
+
   float innerRadius = 2.6;
   float outerRadius = 12.0;
 
@@ -279,6 +370,7 @@ void adiskColor(vec3 pos, inout vec3 color, inout float alpha) {
   if (density < 0.001) {
     return;
   }
+  rayDiskSamples += 1.0;
 
   vec3 sphericalCoord = toSpherical(pos);
 
@@ -297,11 +389,12 @@ void adiskColor(vec3 pos, inout vec3 color, inout float alpha) {
 
   float noise = 1.0;
   for (int i = 0; i < int(adiskNoiseLOD); i++) {
+    pixelCost.b += 1.0;
     noise *= 0.5 * snoise(sphericalCoord * pow(i, 2) * adiskNoiseScale) + 0.5;
     if (i % 2 == 0) {
-      sphericalCoord.y += time * adiskSpeed;
+      sphericalCoord.y += adiskPhase;
     } else {
-      sphericalCoord.y -= time * adiskSpeed;
+      sphericalCoord.y -= adiskPhase;
     }
   }
 
@@ -315,14 +408,15 @@ vec3 traceColor(vec3 pos, vec3 dir) {
   vec3 color = vec3(0.0);
   float alpha = 1.0;
 
-  float STEP_SIZE = 0.1;
+  float STEP_SIZE = 0.1 * 300.0 / maxSteps;
   dir *= STEP_SIZE;
 
   // Initial values
   vec3 h = cross(pos, dir);
   float h2 = dot(h, h);
 
-  for (int i = 0; i < 300; i++) {
+  for (int i = 0; i < int(maxSteps); i++) {
+    pixelCost.r += 1.0;
     if (renderBlackHole > 0.5) {
       // If gravatational lensing is applied
       if (gravatationalLensing > 0.5) {
@@ -332,7 +426,8 @@ vec3 traceColor(vec3 pos, vec3 dir) {
 
       // Reach event horizon
       if (dot(pos, pos) < 1.0) {
-        return color;
+        rayCaptured = true;
+        return vtFeedback > 0.5 ? vec3(0.0) : color;
       }
 
       float minDistance = INFINITY;
@@ -346,7 +441,7 @@ vec3 traceColor(vec3 pos, vec3 dir) {
         ring.rotateSpeed = 0.08;
         ringColor(pos, dir, ring, minDistance, color);
       } else {
-        if (adiskEnabled > 0.5) {
+        if (adiskEnabled > 0.5 && vtFeedback < 0.5) {
           adiskColor(pos, color, alpha);
         }
       }
@@ -357,7 +452,14 @@ vec3 traceColor(vec3 pos, vec3 dir) {
 
   // Sample skybox color
   dir = rotateVector(dir, vec3(0.0, 1.0, 0.0), time);
-  color += texture(galaxy, dir).rgb * alpha;
+  if (panoramaEnabled > 0.5) {
+    if (vtFeedback > 0.5) {
+      return virtualPanoramaRequest(dir);
+    }
+    color += virtualPanoramaColor(dir) * alpha;
+  } else {
+    color += texture(galaxy, dir).rgb * alpha;
+  }
   return color;
 }
 
@@ -375,8 +477,7 @@ void main() {
   } else if (topView > 0.5) {
     cameraPos = vec3(15.0, 15.0, 0.0);
   } else {
-    cameraPos = vec3(-cos(time * 0.1) * 15.0, sin(time * 0.1) * 15.0,
-                     sin(time * 0.1) * 15.0);
+    cameraPos = vec3(cameraOrbitX, cameraOrbitY, cameraOrbitZ);
   }
 
   vec3 target = vec3(0.0, 0.0, 0.0);
@@ -390,4 +491,21 @@ void main() {
   dir = view * dir;
 
   fragColor.rgb = traceColor(pos, dir);
+  if (debugCostView > 0.5) {
+    fragColor.rgb = pixelCost;
+  }
+
+#ifdef GL_ARB_shader_storage_buffer_object
+  if (countWork > 0.5) {
+    atomicAdd(steps, uint(pixelCost.r));
+    if (rayDiskSamples > 0.0) {
+      atomicAdd(diskSamples, uint(rayDiskSamples));
+    }
+    if (rayCaptured) {
+      atomicAdd(capturedRays, 1u);
+    } else {
+      atomicAdd(escapedRays, 1u);
+    }
+  }
+#endif
 }
@@ -1,4 +1,5 @@
 #version 330 core
+#extension GL_ARB_shader_storage_buffer_object : enable
 
 in vec2 uv;
 
@@ -7,10 +8,28 @@ out vec4 fragColor;
 uniform vec2 resolution;
 uniform sampler2D texture0; // Input color texture
 
+// Work counters, see work_counters.h. Counted only when countWork is set.
+uniform float countWork = 0.0;
+#ifdef GL_ARB_shader_storage_buffer_object
+layout(std430) buffer WorkCounters {
+  uint steps;
+  uint diskSamples;
+  uint capturedRays;
+  uint escapedRays;
+  uint bloomSamples;
+};
+#endif
+
 void main() {
   vec2 inputTexelSize = 1.0 / resolution * 0.5;
   vec4 o = inputTexelSize.xyxy * vec4(-1.0, -1.0, 1.0, 1.0); // Offset
   fragColor =
       0.25 * (texture(texture0, uv + o.xy) + texture(texture0, uv + o.zy) +
               texture(texture0, uv + o.xw) + texture(texture0, uv + o.zw));
-}
\ No newline at end of file
+
+#ifdef GL_ARB_shader_storage_buffer_object
+  if (countWork > 0.5) {
+    atomicAdd(bloomSamples, 4u);
+  }
+#endif
+}
@@ -1,4 +1,5 @@
 #version 330 core
+#extension GL_ARB_shader_storage_buffer_object : enable
 
 in vec2 uv;
 
@@ -8,6 +9,18 @@ uniform vec2 resolution;
 uniform sampler2D texture0;
 uniform sampler2D texture1;
 
+// Work counters, see work_counters.h. Counted only when countWork is set.
+uniform float countWork = 0.0;
+#ifdef GL_ARB_shader_storage_buffer_object
+layout(std430) buffer WorkCounters {
+  uint steps;
+  uint diskSamples;
+  uint capturedRays;
+  uint escapedRays;
+  uint bloomSamples;
+};
+#endif
+
 void main() {
   vec2 inputTexelSize = 1.0 / resolution * 0.5;
   vec4 o = inputTexelSize.xyxy * vec4(-1.0, -1.0, 1.0, 1.0); // Offset
@@ -17,4 +30,10 @@ void main() {
 
   fragColor += texture(texture1, uv);
   fragColor.a = 1.0;
-}
\ No newline at end of file
+
+#ifdef GL_ARB_shader_storage_buffer_object
+  if (countWork > 0.5) {
+    atomicAdd(bloomSamples, 5u);
+  }
+#endif
+}
@@ -0,0 +1,32 @@
+#version 330 core
+
+in vec2 uv;
+
+out vec4 fragColor;
+
+// Per-pixel work written by blackhole_main.frag with debugCostView set:
+// r = integration steps, g = adiskColor() calls, b = noise octaves.
+uniform sampler2D texture0;
+uniform vec2 resolution;
+
+// 0 = steps, 1 = adiskColor() calls, 2 = noise octaves.
+uniform float costChannel = 0.0;
+// Cost mapped to the hot end of the palette.
+uniform float costMax = 300.0;
+
+// Black -> blue -> cyan -> green -> yellow -> red -> white.
+vec3 heatmap(float t) {
+  const vec3 stops[7] = vec3[7](vec3(0.0, 0.0, 0.0), vec3(0.0, 0.0, 1.0),
+                                vec3(0.0, 1.0, 1.0), vec3(0.0, 1.0, 0.0),
+                                vec3(1.0, 1.0, 0.0), vec3(1.0, 0.0, 0.0),
+                                vec3(1.0, 1.0, 1.0));
+  float x = clamp(t, 0.0, 1.0) * 6.0;
+  int i = min(int(x), 5);
+  return mix(stops[i], stops[i + 1], x - float(i));
+}
+
+void main() {
+  vec3 cost = texture(texture0, uv).rgb;
+  float value = costChannel < 0.5 ? cost.r : (costChannel < 1.5 ? cost.g : cost.b);
+  fragColor = vec4(heatmap(value / max(costMax, 1.0)), 1.0);
+}
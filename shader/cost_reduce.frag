@@ -0,0 +1,19 @@
+#version 330 core
+
+out vec4 fragColor;
+
+// Per-pixel work written by blackhole_main.frag with debugCostView set.
+uniform sampler2D texture0;
+
+// One fragment per row of texture0: the sum of that row. The counts are
+// small integers, so the float sums stay exact; the rows are added up on the
+// CPU in double precision.
+void main() {
+  int row = int(gl_FragCoord.y);
+  int width = textureSize(texture0, 0).x;
+  vec3 sum = vec3(0.0);
+  for (int x = 0; x < width; x++) {
+    sum += texelFetch(texture0, ivec2(x, row), 0).rgb;
+  }
+  fragColor = vec4(sum, 0.0);
+}
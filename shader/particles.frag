@@ -0,0 +1,7 @@
+#version 330 core
+
+in vec3 particleColor;
+
+out vec4 fragColor;
+
+void main() { fragColor = vec4(particleColor, 0.0); }
@@ -0,0 +1,133 @@
+#version 330 core
+
+// Simulated disk particles, additive points. The camera is the one of
+// blackhole_main.frag, driven by the same uniforms. With a lensing table,
+// instance 0 draws every particle at its primary image and instance 1 at its
+// secondary image. Without one the particles are drawn unlensed, and the
+// ones whose line of sight crosses the black hole's shadow are dropped.
+
+// Structure of arrays, one attribute per component.
+layout(location = 0) in float positionX;
+layout(location = 1) in float positionY;
+layout(location = 2) in float positionZ;
+layout(location = 3) in float velocityX;
+layout(location = 4) in float velocityY;
+layout(location = 5) in float velocityZ;
+
+out vec3 particleColor;
+
+uniform vec2 resolution;
+uniform float mouseX;
+uniform float mouseY;
+uniform float frontView = 0.0;
+uniform float topView = 0.0;
+uniform float cameraRoll = 0.0;
+uniform float mouseControl = 0.0;
+uniform float fovScale = 1.0;
+uniform float cameraOrbitX = 15.0;
+uniform float cameraOrbitY = 0.0;
+uniform float cameraOrbitZ = 0.0;
+
+uniform sampler2D colorMap;
+// Frame clock seconds from the snapshot to the rendered frame.
+uniform float particleDt = 0.0;
+// Radiance added by one particle.
+uniform float particleIntensity = 1.0;
+
+// See LensingTable: x = psi, y = source radius, z = camera distance.
+uniform sampler3D lensingTable;
+uniform float lensed = 0.0;
+uniform float minRadius;
+uniform float maxRadius;
+uniform float minCameraDistance;
+uniform float maxCameraDistance;
+
+const float PI = 3.14159265359;
+
+// Apparent radius of the shadow, 3 * sqrt(3) / 2 horizon radii.
+const float SHADOW_RADIUS = 2.6;
+const float OUTER_RADIUS = 12.0;
+
+mat3 lookAt(vec3 origin, vec3 target, float roll) {
+  vec3 rr = vec3(sin(roll), cos(roll), 0.0);
+  vec3 ww = normalize(target - origin);
+  vec3 uu = normalize(cross(ww, rr));
+  vec3 vv = normalize(cross(uu, ww));
+
+  return mat3(uu, vv, ww);
+}
+
+// primary angle, primary magnification, secondary angle, secondary
+// magnification.
+vec4 lensedImages(float psi, float radius, float cameraDistance) {
+  vec3 size = vec3(textureSize(lensingTable, 0));
+  vec3 coord = vec3(psi / PI,
+                    (radius - minRadius) / (maxRadius - minRadius),
+                    (cameraDistance - minCameraDistance) /
+                        (maxCameraDistance - minCameraDistance));
+  coord = (clamp(coord, 0.0, 1.0) * (size - 1.0) + 0.5) / size;
+  return texture(lensingTable, coord);
+}
+
+vec3 cameraPosition() {
+  if (mouseControl > 0.5) {
+    vec2 mouse = clamp(vec2(mouseX, mouseY) / resolution.xy, 0.0, 1.0) - 0.5;
+    return vec3(-cos(mouse.x * 10.0) * 15.0, mouse.y * 30.0,
+                sin(mouse.x * 10.0) * 15.0);
+  } else if (frontView > 0.5) {
+    return vec3(10.0, 1.0, 10.0);
+  } else if (topView > 0.5) {
+    return vec3(15.0, 15.0, 0.0);
+  }
+  return vec3(cameraOrbitX, cameraOrbitY, cameraOrbitZ);
+}
+
+void main() {
+  vec3 pos = vec3(positionX, positionY, positionZ) +
+             vec3(velocityX, velocityY, velocityZ) * particleDt;
+  vec3 cameraPos = cameraPosition();
+  vec3 ray = pos - cameraPos;
+  float magnification = 1.0;
+
+  if (lensed > 0.5) {
+    // The image lies in the plane through the camera, the hole and the
+    // particle, at the tabulated angle from the direction to the hole. The
+    // secondary image is on the opposite side.
+    float radius = length(pos);
+    float cameraDistance = length(cameraPos);
+    vec3 axis = cameraPos / cameraDistance;
+    vec3 side = pos - axis * dot(pos, axis);
+    float psi = acos(clamp(dot(pos, axis) / radius, -1.0, 1.0));
+    vec4 images = lensedImages(psi, radius, cameraDistance);
+    float angle = gl_InstanceID == 0 ? images.x : images.z;
+    magnification = gl_InstanceID == 0 ? images.y : images.w;
+    if (angle < 0.0 || dot(side, side) < 1e-8) {
+      gl_Position = vec4(2.0, 2.0, 2.0, 1.0); // Clipped.
+      particleColor = vec3(0.0);
+      return;
+    }
+    side = normalize(side) * (gl_InstanceID == 0 ? 1.0 : -1.0);
+    ray = cos(angle) * -axis + sin(angle) * side;
+  } else {
+    // Closest approach of the line of sight to the black hole.
+    float t = clamp(-dot(cameraPos, ray) / dot(ray, ray), 0.0, 1.0);
+    if (length(cameraPos + ray * t) < SHADOW_RADIUS) {
+      gl_Position = vec4(2.0, 2.0, 2.0, 1.0); // Clipped.
+      particleColor = vec3(0.0);
+      return;
+    }
+  }
+
+  // Inverse of the ray setup in blackhole_main.frag:
+  // dir = view * vec3(-uv.x * fovScale, uv.y * fovScale, 1.0), with uv.x
+  // scaled by the aspect ratio.
+  mat3 view = lookAt(cameraPos, vec3(0.0), radians(cameraRoll));
+  vec3 local = ray * view;
+  float aspect = resolution.x / resolution.y;
+  gl_Position = vec4(-local.x * 2.0 / (fovScale * aspect),
+                     local.y * 2.0 / fovScale, 0.0, local.z);
+
+  particleColor =
+      textureLod(colorMap, vec2(length(pos) / OUTER_RADIUS, 0.5), 0.0).rgb *
+      particleIntensity * magnification;
+}
@@ -0,0 +1,222 @@
+#include <benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+
+bool CameraPath::load(const std::string &file) {
+  std::ifstream ifs(file, std::ios::in);
+  if (!ifs.is_open()) {
+    std::cout << "ERROR: Failed to open camera path: " << file << std::endl;
+    return false;
+  }
+
+  keys.clear();
+  std::string line;
+  while (std::getline(ifs, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream iss(line);
+    CameraKey key;
+    int mouseControl, frontView, topView;
+    if (iss >> key.time >> key.mouseX >> key.mouseY >> mouseControl >>
+        frontView >> topView) {
+      key.mouseControl = mouseControl != 0;
+      key.frontView = frontView != 0;
+      key.topView = topView != 0;
+      keys.push_back(key);
+    }
+  }
+  std::sort(keys.begin(), keys.end(),
+            [](const CameraKey &a, const CameraKey &b) {
+              return a.time < b.time;
+            });
+  return !keys.empty();
+}
+
+CameraKey CameraPath::sample(double time) const {
+  if (keys.empty()) {
+    return CameraKey();
+  }
+  if (time <= keys.front().time) {
+    return keys.front();
+  }
+  if (time >= keys.back().time) {
+    return keys.back();
+  }
+
+  auto next = std::upper_bound(
+      keys.begin(), keys.end(), time,
+      [](double t, const CameraKey &key) { return t < key.time; });
+  const CameraKey &a = *(next - 1);
+  const CameraKey &b = *next;
+  const float t = (float)((time - a.time) / (b.time - a.time));
+
+  CameraKey key = a;
+  key.time = time;
+  key.mouseX = a.mouseX + (b.mouseX - a.mouseX) * t;
+  key.mouseY = a.mouseY + (b.mouseY - a.mouseY) * t;
+  return key;
+}
+
+void BenchmarkRecorder::recordGpuFrame(
+    const std::map<std::string, double> &passTimes) {
+  if (gpuFramesSeen++ < warmupFrames) {
+    return;
+  }
+  double total = 0.0;
+  for (auto const &[name, ms] : passTimes) {
+    gpuPasses[name].push_back(ms);
+    total += ms;
+  }
+  gpuFrames.push_back(total);
+}
+
+void BenchmarkRecorder::recordCounters(
+    const std::string &group, const std::map<std::string, double> &counters) {
+  if (counterGroupFramesSeen[group]++ < warmupFrames) {
+    return;
+  }
+  for (auto const &[name, value] : counters) {
+    counterGroups[group][name].push_back(value);
+  }
+}
+
+void BenchmarkRecorder::recordCpuFrame(double ms) {
+  if (cpuFramesSeen++ < warmupFrames) {
+    return;
+  }
+  cpuFrames.push_back(ms);
+}
+
+void BenchmarkRecorder::recordCpuCounters(
+    const std::vector<ThreadPerfCounters> &threads) {
+  if (cpuFramesSeen < warmupFrames) {
+    return;
+  }
+  for (const ThreadPerfCounters &thread : threads) {
+    cpuCounters[thread.name] += thread.frame;
+    cpuCounterFrames[thread.name]++;
+  }
+}
+
+void BenchmarkRecorder::recordEnergy(double joules) {
+  // The reading at the end of the last warm-up frame (or of the first frame
+  // without warm-up) is the baseline.
+  if (cpuFramesSeen + 1 < warmupFrames) {
+    return;
+  }
+  if (energyStart < 0.0) {
+    energyStart = joules;
+    return;
+  }
+  energyEnd = joules;
+  energyFrames++;
+}
+
+void BenchmarkRecorder::setInfo(const std::string &key,
+                                const std::string &value) {
+  std::string escaped;
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+    }
+    escaped += c;
+  }
+  info[key] = "\"" + escaped + "\"";
+}
+
+void BenchmarkRecorder::setInfo(const std::string &key, double value) {
+  std::ostringstream oss;
+  oss << value;
+  info[key] = oss.str();
+}
+
+// Nearest-rank percentile of sorted samples.
+static double percentile(const std::vector<double> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+  return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+}
+
+static void writeStats(std::ostream &os, const std::vector<double> &samples) {
+  std::vector<double> sorted(samples);
+  std::sort(sorted.begin(), sorted.end());
+  const double mean =
+      sorted.empty()
+          ? 0.0
+          : std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size();
+  os << "{\"samples\": " << sorted.size() << ", \"mean\": " << mean
+     << ", \"p50\": " << percentile(sorted, 50.0)
+     << ", \"p95\": " << percentile(sorted, 95.0)
+     << ", \"p99\": " << percentile(sorted, 99.0)
+     << ", \"max\": " << (sorted.empty() ? 0.0 : sorted.back()) << "}";
+}
+
+bool BenchmarkRecorder::writeJson(const std::string &file) const {
+  std::ofstream ofs(file, std::ios::out);
+  if (!ofs.is_open()) {
+    std::cout << "ERROR: Failed to open file: " << file << std::endl;
+    return false;
+  }
+
+  ofs << "{\n";
+  for (auto const &[key, value] : info) {
+    ofs << "  \"" << key << "\": " << value << ",\n";
+  }
+  ofs << "  \"cpuFrameMs\": ";
+  writeStats(ofs, cpuFrames);
+  ofs << ",\n  \"gpuFrameMs\": ";
+  writeStats(ofs, gpuFrames);
+  ofs << ",\n  \"gpuPassMs\": {";
+  bool first = true;
+  for (auto const &[name, samples] : gpuPasses) {
+    ofs << (first ? "\n" : ",\n") << "    \"" << name << "\": ";
+    writeStats(ofs, samples);
+    first = false;
+  }
+  ofs << "\n  }";
+  for (auto const &[group, counters] : counterGroups) {
+    ofs << ",\n  \"" << group << "\": {";
+    first = true;
+    for (auto const &[name, samples] : counters) {
+      ofs << (first ? "\n" : ",\n") << "    \"" << name << "\": ";
+      writeStats(ofs, samples);
+      first = false;
+    }
+    ofs << "\n  }";
+  }
+  if (!cpuCounters.empty()) {
+    ofs << ",\n  \"cpuCounters\": {";
+    first = true;
+    for (auto const &[name, total] : cpuCounters) {
+      const double frames = cpuCounterFrames.at(name);
+      ofs << (first ? "\n" : ",\n") << "    \"" << name << "\": "
+          << "{\"frames\": " << frames
+          << ", \"cyclesPerFrame\": " << total.cycles / frames
+          << ", \"instructionsPerFrame\": " << total.instructions / frames
+          << ", \"ipc\": " << total.ipc()
+          << ", \"cacheMissRate\": " << total.cacheMissRate()
+          << ", \"branchMissRate\": " << total.branchMissRate() << "}";
+      first = false;
+    }
+    ofs << "\n  }";
+  }
+  if (energyFrames > 0) {
+    const double joules = energyEnd - energyStart;
+    const double seconds =
+        std::accumulate(cpuFrames.begin(), cpuFrames.end(), 0.0) / 1000.0;
+    ofs << ",\n  \"energy\": {\"frames\": " << energyFrames
+        << ", \"joules\": " << joules
+        << ", \"joulesPerFrame\": " << joules / energyFrames
+        << ", \"watts\": " << (seconds > 0.0 ? joules / seconds : 0.0) << "}";
+  }
+  ofs << "\n}\n";
+  return true;
+}
@@ -0,0 +1,65 @@
+#include <cost_heatmap.h>
+
+#include <render.h>
+
+CostReduction::~CostReduction() {
+  if (rowSums) {
+    releaseFramebuffer(rowSums);
+    glDeleteTextures(1, &rowSums);
+  }
+  if (readbackBuffers[0]) {
+    glDeleteBuffers(2, readbackBuffers);
+  }
+}
+
+void CostReduction::reduce(GLuint costTexture, int height) {
+  if (!readbackBuffers[0]) {
+    glGenBuffers(2, readbackBuffers);
+  }
+  if (rowSumsHeight != height) {
+    if (rowSums) {
+      releaseFramebuffer(rowSums);
+      glDeleteTextures(1, &rowSums);
+    }
+    rowSums = createColorTexture(1, height, GL_RGBA32F);
+    rowSumsHeight = height;
+    for (GLuint buffer : readbackBuffers) {
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+      glBufferData(GL_PIXEL_PACK_BUFFER, height * 4 * sizeof(float), NULL,
+                   GL_STREAM_READ);
+    }
+    readbackRows[0] = readbackRows[1] = 0;
+  }
+
+  RenderToTextureInfo rtti;
+  rtti.fragShader = "shader/cost_reduce.frag";
+  rtti.textureUniforms["texture0"] = costTexture;
+  rtti.targetTexture = rowSums;
+  rtti.width = 1;
+  rtti.height = height;
+  renderToTexture(rtti);
+
+  glBindTexture(GL_TEXTURE_2D, rowSums);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[readbackIndex]);
+  glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, 0);
+  readbackRows[readbackIndex] = height;
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  // Collect the readback queued on the previous call.
+  readbackIndex ^= 1;
+  const int rows = readbackRows[readbackIndex];
+  if (rows > 0) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[readbackIndex]);
+    const float *sums = (const float *)glMapBufferRange(
+        GL_PIXEL_PACK_BUFFER, 0, rows * 4 * sizeof(float), GL_MAP_READ_BIT);
+    if (sums) {
+      glm::dvec3 total(0.0);
+      for (int y = 0; y < rows; y++) {
+        total += glm::dvec3(sums[y * 4], sums[y * 4 + 1], sums[y * 4 + 2]);
+      }
+      frameTotals = total;
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
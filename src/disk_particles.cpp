@@ -0,0 +1,140 @@
+#include <disk_particles.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <job_system.h>
+
+static const float PI = 3.14159265f;
+static const float GM = 0.5f;
+// Paczynski-Wiita: gravity of GM / (r - rs)^2 instead of GM / r^2.
+static const float SCHWARZSCHILD_RADIUS = 1.0f;
+// Keeps the force finite for particles that already crossed the horizon;
+// they are respawned right after.
+static const float MIN_DISTANCE = 0.05f;
+static const float RESPAWN_INNER_RADIUS = 1.5f;
+static const float RESPAWN_OUTER_RADIUS = 2.0f * DiskParticles::OUTER_RADIUS;
+// Half thickness of the disk relative to the radius.
+static const float DISK_ASPECT = 0.02f;
+// Relative spread of the initial speed, which makes the orbits eccentric.
+static const float SPEED_SPREAD = 0.03f;
+
+static const int GRAIN_SIZE = 16384;
+
+static uint32_t hash(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return x;
+}
+
+static float random01(uint32_t &state) {
+  state = hash(state);
+  return (float)(state >> 8) * (1.0f / 16777216.0f);
+}
+
+static float gravityShift(bool relativistic) {
+  return relativistic ? SCHWARZSCHILD_RADIUS : 0.0f;
+}
+
+// Puts particle i on a slightly perturbed circular orbit. The random stream
+// depends only on i and key, so any thread can do this for any particle.
+static void place(int i, uint32_t key, float shift, float *px, float *py,
+                  float *pz, float *vx, float *vy, float *vz) {
+  uint32_t state = hash((uint32_t)i * 0x9e3779b9u ^ key);
+  const float r = DiskParticles::INNER_RADIUS +
+                  (DiskParticles::OUTER_RADIUS - DiskParticles::INNER_RADIUS) *
+                      random01(state);
+  const float angle = 2.0f * PI * random01(state);
+  const float height = (2.0f * random01(state) - 1.0f) * DISK_ASPECT * r;
+  const float speed = sqrtf(GM * r) / (r - shift) *
+                      (1.0f + SPEED_SPREAD * (2.0f * random01(state) - 1.0f));
+  px[i] = r * cosf(angle);
+  py[i] = height;
+  pz[i] = r * sinf(angle);
+  vx[i] = -sinf(angle) * speed;
+  vy[i] = 0.0f;
+  vz[i] = cosf(angle) * speed;
+}
+
+// Semi-implicit Euler: kick, then drift. No branches, so the loop vectorizes.
+static void integrate(int begin, int end, float dt, float shift,
+                      float *__restrict px, float *__restrict py,
+                      float *__restrict pz, float *__restrict vx,
+                      float *__restrict vy, float *__restrict vz) {
+  for (int i = begin; i < end; i++) {
+    const float r = sqrtf(px[i] * px[i] + py[i] * py[i] + pz[i] * pz[i]);
+    const float d = std::max(r - shift, MIN_DISTANCE);
+    const float k = GM * dt / (std::max(r, MIN_DISTANCE) * d * d);
+    vx[i] -= k * px[i];
+    vy[i] -= k * py[i];
+    vz[i] -= k * pz[i];
+    px[i] += vx[i] * dt;
+    py[i] += vy[i] * dt;
+    pz[i] += vz[i] * dt;
+  }
+}
+
+static void scale(int begin, int end, float factor,
+                  const float *__restrict in, float *__restrict out) {
+  for (int i = begin; i < end; i++) {
+    out[i] = in[i] * factor;
+  }
+}
+
+void DiskParticles::seed(int count, bool relativistic, uint32_t seed) {
+  x.resize(count);
+  y.resize(count);
+  z.resize(count);
+  vx.resize(count);
+  vy.resize(count);
+  vz.resize(count);
+  generation = seed;
+
+  const float shift = gravityShift(relativistic);
+  jobSystem().parallelFor(count, GRAIN_SIZE, [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      place(i, seed, shift, x.data(), y.data(), z.data(), vx.data(),
+            vy.data(), vz.data());
+    }
+  });
+}
+
+void DiskParticles::step(float dt, bool relativistic, float velocityScale,
+                         ParticleSnapshot &out) {
+  const int count = size();
+  out.x.resize(count);
+  out.y.resize(count);
+  out.z.resize(count);
+  out.vx.resize(count);
+  out.vy.resize(count);
+  out.vz.resize(count);
+  generation++;
+
+  const float shift = gravityShift(relativistic);
+  const uint32_t key = hash(generation);
+  const float innerRadius2 = RESPAWN_INNER_RADIUS * RESPAWN_INNER_RADIUS;
+  const float outerRadius2 = RESPAWN_OUTER_RADIUS * RESPAWN_OUTER_RADIUS;
+  jobSystem().parallelFor(count, GRAIN_SIZE, [&](int begin, int end) {
+    integrate(begin, end, dt, shift, x.data(), y.data(), z.data(), vx.data(),
+              vy.data(), vz.data());
+
+    // Rare, so kept out of the vectorized loop.
+    for (int i = begin; i < end; i++) {
+      const float r2 = x[i] * x[i] + y[i] * y[i] + z[i] * z[i];
+      if (r2 < innerRadius2 || r2 > outerRadius2) {
+        place(i, key, shift, x.data(), y.data(), z.data(), vx.data(),
+              vy.data(), vz.data());
+      }
+    }
+
+    std::copy(x.begin() + begin, x.begin() + end, out.x.begin() + begin);
+    std::copy(y.begin() + begin, y.begin() + end, out.y.begin() + begin);
+    std::copy(z.begin() + begin, z.begin() + end, out.z.begin() + begin);
+    scale(begin, end, velocityScale, vx.data(), out.vx.data());
+    scale(begin, end, velocityScale, vy.data(), out.vy.data());
+    scale(begin, end, velocityScale, vz.data(), out.vz.data());
+  });
+}
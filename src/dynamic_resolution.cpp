@@ -0,0 +1,50 @@
+#include <dynamic_resolution.h>
+
+#include <algorithm>
+#include <cmath>
+
+void DynamicResolution::update(double gpuFrameMs) {
+  if (gpuFrameMs <= 0.0 || settings.targetFrameMs <= 0.0f) {
+    return;
+  }
+
+  const float DEAD_BAND = 0.05f;
+  const float DECREASE_GAIN = 0.5f;
+  const float INCREASE_GAIN = 0.05f;
+
+  float error = (settings.targetFrameMs - (float)gpuFrameMs) /
+                settings.targetFrameMs;
+  if (std::fabs(error) < DEAD_BAND) {
+    return;
+  }
+  error = std::max(error, -1.0f);
+  quality += error * (error < 0.0f ? DECREASE_GAIN : INCREASE_GAIN);
+  quality = std::min(std::max(quality, 0.0f), 1.0f);
+
+  // Hysteresis, in steps: a quality level hovering between two steps does
+  // not flip the render size back and forth.
+  const float SCALE_HYSTERESIS = 0.25f;
+  const float idealStep = quality * (RENDER_SCALE_STEPS - 1);
+  if (std::fabs(idealStep - scaleStep) > 0.5f + SCALE_HYSTERESIS) {
+    scaleStep = (int)std::lround(idealStep);
+  }
+}
+
+float DynamicResolution::renderScale() const {
+  // Cost grows with the pixel count, so interpolate the area linearly.
+  const float minArea = settings.minRenderScale * settings.minRenderScale;
+  const float maxArea = settings.maxRenderScale * settings.maxRenderScale;
+  const float level = (float)scaleStep / (RENDER_SCALE_STEPS - 1);
+  return std::sqrt(minArea + (maxArea - minArea) * level);
+}
+
+int DynamicResolution::stepCount() const {
+  return (int)std::lround(settings.minSteps +
+                          (settings.maxSteps - settings.minSteps) * quality);
+}
+
+int DynamicResolution::bloomIterations() const {
+  return (int)std::lround(
+      settings.minBloomIterations +
+      (settings.maxBloomIterations - settings.minBloomIterations) * quality);
+}
@@ -0,0 +1,51 @@
+#include <frame_clock.h>
+
+#include <atomic>
+
+#include <GLFW/glfw3.h>
+
+static bool fixedStep = false;
+static double fixedTimeStep = 0.0;
+static double fixedTime = 0.0;
+
+// Wall-clock time spent paused, and the frozen time while paused. Read by
+// the simulation thread.
+static std::atomic<double> pausedTotal{0.0};
+static std::atomic<double> pausedAt{0.0};
+static std::atomic<bool> paused{false};
+
+double getFrameTime() {
+  if (paused) {
+    return pausedAt;
+  }
+  return fixedStep ? fixedTime : glfwGetTime() - pausedTotal;
+}
+
+void useFixedStepClock(double timeStep) {
+  fixedStep = true;
+  fixedTimeStep = timeStep;
+  fixedTime = 0.0;
+}
+
+void advanceFrameClock() {
+  if (fixedStep && !paused) {
+    fixedTime += fixedTimeStep;
+  }
+}
+
+void setFrameClockPaused(bool pause) {
+  if (pause == paused) {
+    return;
+  }
+  if (pause) {
+    pausedAt = getFrameTime();
+    paused = true;
+  } else {
+    if (!fixedStep) {
+      pausedTotal = glfwGetTime() - pausedAt;
+    }
+    paused = false;
+  }
+}
+
+bool isFrameClockPaused() { return paused; }
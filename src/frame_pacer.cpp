@@ -0,0 +1,208 @@
+#include <frame_pacer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+#include <GLFW/glfw3.h>
+
+#include <profiler.h>
+
+// The CPU and GPU clocks drift apart slowly; re-measure their offset.
+static const double CALIBRATION_INTERVAL = 1.0;
+static const double LATENCY_SMOOTHING = 0.1;
+// sleep_for() overshoots by up to a scheduler tick; the rest is spun.
+static const double SPIN_TIME = 0.002;
+
+static const char *MODE_NAMES[] = {"vsync", "adaptive", "capped", "uncapped"};
+
+const char *pacingModeName(PacingMode mode) { return MODE_NAMES[(int)mode]; }
+
+bool parsePacingMode(const std::string &name, PacingMode &mode) {
+  for (int i = 0; i < 4; i++) {
+    if (name == MODE_NAMES[i]) {
+      mode = (PacingMode)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void sleepUntil(double time) {
+  const double remaining = time - glfwGetTime();
+  if (remaining > SPIN_TIME) {
+    std::this_thread::sleep_for(
+        std::chrono::duration<double>(remaining - SPIN_TIME));
+  }
+  while (glfwGetTime() < time) {
+    std::this_thread::yield();
+  }
+}
+
+FramePacer::FramePacer(double refreshRate, bool presenting)
+    : refreshRate(refreshRate > 0.0 ? refreshRate : 60.0),
+      presenting(presenting) {
+  tearControl = presenting &&
+                (glfwExtensionSupported("WGL_EXT_swap_control_tear") ||
+                 glfwExtensionSupported("GLX_EXT_swap_control_tear"));
+  timestamps = GLEW_ARB_timer_query;
+  if (timestamps) {
+    for (Frame &frame : frames) {
+      glGenQueries(1, &frame.query);
+    }
+  }
+  lastSwap = glfwGetTime();
+}
+
+FramePacer::~FramePacer() {
+  for (Frame &frame : frames) {
+    if (frame.query) {
+      glDeleteQueries(1, &frame.query);
+    }
+  }
+  if (previousFence) {
+    glDeleteSync(previousFence);
+  }
+}
+
+bool FramePacer::vsyncMode() const {
+  return presenting && (settings.mode == PacingMode::VSYNC ||
+                        settings.mode == PacingMode::ADAPTIVE_VSYNC);
+}
+
+double FramePacer::period() const {
+  switch (settings.mode) {
+  case PacingMode::CAPPED:
+    return 1.0 / std::max(settings.capFps, 1.0f);
+  case PacingMode::UNCAPPED:
+    return 0.0;
+  default:
+    return 1.0 / refreshRate;
+  }
+}
+
+void FramePacer::applySwapInterval() {
+  if (!presenting) {
+    return;
+  }
+  int interval = 0;
+  if (settings.mode == PacingMode::VSYNC) {
+    interval = 1;
+  } else if (settings.mode == PacingMode::ADAPTIVE_VSYNC) {
+    interval = tearControl ? -1 : 1;
+  }
+  if (interval != appliedInterval) {
+    glfwSwapInterval(interval);
+    appliedInterval = interval;
+  }
+}
+
+void FramePacer::calibrate() {
+  const double now = glfwGetTime();
+  if (!timestamps || now - lastCalibration < CALIBRATION_INTERVAL) {
+    return;
+  }
+  GLint64 gpuTime = 0;
+  glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+  const double after = glfwGetTime();
+  clockOffset = (now + after) * 0.5 - gpuTime * 1.0e-9;
+  lastCalibration = after;
+}
+
+void FramePacer::resolve() {
+  for (Frame &frame : frames) {
+    if (!frame.pending) {
+      continue;
+    }
+    GLint available = 0;
+    glGetQueryObjectiv(frame.query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+      continue;
+    }
+    frame.pending = false;
+    GLuint64 gpuTime = 0;
+    glGetQueryObjectui64v(frame.query, GL_QUERY_RESULT, &gpuTime);
+    const double done = gpuTime * 1.0e-9 + clockOffset;
+
+    work[workIndex] = std::max(done - frame.start, 0.0);
+    workIndex = (workIndex + 1) % WORK_HISTORY;
+
+    // With vsync the image is shown at the first vblank it made.
+    double photon = done;
+    if (frame.deadline > 0.0) {
+      const double p = 1.0 / refreshRate;
+      photon = frame.deadline +
+               std::max(ceil((done - frame.deadline) / p), 0.0) * p;
+    }
+    const double sample = std::max(photon - frame.latched, 0.0);
+    latency = latency > 0.0 ? latency + (sample - latency) * LATENCY_SMOOTHING
+                            : sample;
+  }
+  // Plan for the slowest recent frame rather than the average one; a
+  // missed vblank costs a whole refresh period.
+  predictedWork = *std::max_element(work, work + WORK_HISTORY);
+}
+
+void FramePacer::beginFrame() {
+  PROFILE_ZONE("pacing");
+  applySwapInterval();
+
+  // Do not queue frames ahead of the GPU: every queued frame is a frame of
+  // latency.
+  if (previousFence) {
+    GLenum status;
+    do {
+      status = glClientWaitSync(previousFence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                100000000);
+    } while (status == GL_TIMEOUT_EXPIRED);
+    glDeleteSync(previousFence);
+    previousFence = 0;
+  }
+  calibrate();
+  resolve();
+
+  const double now = glfwGetTime();
+  const double p = period();
+  const double lead = predictedWork + settings.marginMs * 1.0e-3;
+  double deadline = 0.0;
+  if (vsyncMode()) {
+    // The next vblank this frame can still make.
+    deadline = lastSwap + p;
+    while (deadline - lead < now) {
+      deadline += p;
+    }
+  } else if (p > 0.0) {
+    // Keep the cadence, unless the last frame ran late.
+    deadline = std::max(nextDeadline + p, now + lead);
+  }
+  if (deadline > 0.0) {
+    sleepUntil(deadline - lead);
+  }
+  nextDeadline = deadline;
+
+  Frame &frame = frames[frameIndex];
+  frame.pending = false;
+  frame.start = glfwGetTime();
+  frame.latched = frame.start;
+  frame.deadline = vsyncMode() ? deadline : 0.0;
+}
+
+void FramePacer::latchInput() { frames[frameIndex].latched = glfwGetTime(); }
+
+void FramePacer::endRendering() {
+  if (!timestamps) {
+    return;
+  }
+  Frame &frame = frames[frameIndex];
+  glQueryCounter(frame.query, GL_TIMESTAMP);
+  frame.pending = true;
+}
+
+void FramePacer::endFrame() {
+  lastSwap = glfwGetTime();
+  if (settings.mode != PacingMode::UNCAPPED) {
+    previousFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+  frameIndex = (frameIndex + 1) % FRAMES;
+}
@@ -0,0 +1,31 @@
+#include <gl_stats.h>
+
+GlCallStats glCallStats;
+static GlCallStats previousFrame;
+
+GlCallStats endGlStatsFrame() {
+  previousFrame = glCallStats;
+  glCallStats = GlCallStats();
+  return previousFrame;
+}
+
+const GlCallStats &previousGlStatsFrame() { return previousFrame; }
+
+std::vector<std::pair<const char *, int>>
+glCallStatsFields(const GlCallStats &stats) {
+  return {{"framebufferBinds", stats.framebufferBinds},
+          {"programBinds", stats.programBinds},
+          {"textureBinds", stats.textureBinds},
+          {"uniformLookups", stats.uniformLookups},
+          {"uniformUploads", stats.uniformUploads},
+          {"clears", stats.clears},
+          {"draws", stats.draws}};
+}
+
+bool glCallStatsEnabled() {
+#ifdef GL_CALL_STATS
+  return true;
+#else
+  return false;
+#endif
+}
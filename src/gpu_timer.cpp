@@ -0,0 +1,118 @@
+#include <gpu_timer.h>
+
+GpuTimer::~GpuTimer() {
+  for (auto &frame : frames) {
+    for (const Query &query : frame) {
+      glDeleteQueries(1, &query.id);
+    }
+  }
+  if (!freeQueries.empty()) {
+    glDeleteQueries((GLsizei)freeQueries.size(), freeQueries.data());
+  }
+}
+
+void GpuTimer::beginFrame() {
+  frameIndex = (frameIndex + 1) % FRAME_LATENCY;
+  resolveFrame(frameIndex);
+}
+
+void GpuTimer::finish() {
+  end();
+  for (int i = 1; i <= FRAME_LATENCY; i++) {
+    resolveFrame((frameIndex + i) % FRAME_LATENCY);
+  }
+}
+
+void GpuTimer::resolveFrame(int index) {
+  std::vector<Query> &frame = frames[index];
+  if (frame.empty()) {
+    return;
+  }
+
+  // Only publish a frame whose queries all completed, so the per-pass times
+  // always belong to the same frame. GL_QUERY_RESULT waits for the GPU.
+  bool available = true;
+  for (const Query &query : frame) {
+    GLint ready = GL_FALSE;
+    glGetQueryObjectiv(query.id, GL_QUERY_RESULT_AVAILABLE, &ready);
+    available = available && ready == GL_TRUE;
+  }
+  available = available || blocking;
+
+  if (available) {
+    results.clear();
+    orderedResults.clear();
+    totalMs = 0.0;
+    for (const Query &query : frame) {
+      GLuint64 ns = 0;
+      glGetQueryObjectui64v(query.id, GL_QUERY_RESULT, &ns);
+      const double ms = ns / 1.0e6;
+      if (!results.count(query.name)) {
+        orderedResults.emplace_back(query.name, 0.0);
+      }
+      results[query.name] += ms;
+      totalMs += ms;
+    }
+    for (auto &[name, ms] : orderedResults) {
+      ms = results[name];
+    }
+
+    if (csvLog.is_open()) {
+      for (auto const &[name, ms] : orderedResults) {
+        csvLog << resolvedFrames << "," << name << "," << ms << "\n";
+      }
+    }
+    resolvedFrames++;
+
+    if (onFrameResolved) {
+      onFrameResolved(results);
+    }
+  }
+
+  for (const Query &query : frame) {
+    freeQueries.push_back(query.id);
+  }
+  frame.clear();
+}
+
+void GpuTimer::begin(const std::string &name) {
+  if (active) {
+    end();
+  }
+  Query query = {name, acquireQuery()};
+  glBeginQuery(GL_TIME_ELAPSED, query.id);
+  frames[frameIndex].push_back(query);
+  active = true;
+}
+
+void GpuTimer::end() {
+  if (active) {
+    glEndQuery(GL_TIME_ELAPSED);
+    active = false;
+  }
+}
+
+bool GpuTimer::openCsvLog(const std::string &file) {
+  csvLog.open(file, std::ios::out);
+  if (!csvLog.is_open()) {
+    return false;
+  }
+  csvLog << "frame,pass,ms\n";
+  return true;
+}
+
+double GpuTimer::elapsedMs(const std::string &name) const {
+  auto it = results.find(name);
+  return it != results.end() ? it->second : 0.0;
+}
+
+GLuint GpuTimer::acquireQuery() {
+  if (freeQueries.empty()) {
+    GLuint id;
+    glGenQueries(1, &id);
+    return id;
+  }
+  GLuint id = freeQueries.back();
+  freeQueries.pop_back();
+  return id;
+}
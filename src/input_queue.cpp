@@ -0,0 +1,327 @@
+#include <input_queue.h>
+
+#include <cfloat>
+#include <chrono>
+#include <cstring>
+
+#include <GLFW/glfw3.h>
+#include <imgui.h>
+
+static InputQueue *queueOf(GLFWwindow *window) {
+  return (InputQueue *)glfwGetWindowUserPointer(window);
+}
+
+static ImGuiKey translateKey(int key) {
+  if (key >= GLFW_KEY_0 && key <= GLFW_KEY_9) {
+    return (ImGuiKey)(ImGuiKey_0 + (key - GLFW_KEY_0));
+  }
+  if (key >= GLFW_KEY_A && key <= GLFW_KEY_Z) {
+    return (ImGuiKey)(ImGuiKey_A + (key - GLFW_KEY_A));
+  }
+  if (key >= GLFW_KEY_F1 && key <= GLFW_KEY_F12) {
+    return (ImGuiKey)(ImGuiKey_F1 + (key - GLFW_KEY_F1));
+  }
+  if (key >= GLFW_KEY_KP_0 && key <= GLFW_KEY_KP_9) {
+    return (ImGuiKey)(ImGuiKey_Keypad0 + (key - GLFW_KEY_KP_0));
+  }
+  switch (key) {
+  case GLFW_KEY_TAB: return ImGuiKey_Tab;
+  case GLFW_KEY_LEFT: return ImGuiKey_LeftArrow;
+  case GLFW_KEY_RIGHT: return ImGuiKey_RightArrow;
+  case GLFW_KEY_UP: return ImGuiKey_UpArrow;
+  case GLFW_KEY_DOWN: return ImGuiKey_DownArrow;
+  case GLFW_KEY_PAGE_UP: return ImGuiKey_PageUp;
+  case GLFW_KEY_PAGE_DOWN: return ImGuiKey_PageDown;
+  case GLFW_KEY_HOME: return ImGuiKey_Home;
+  case GLFW_KEY_END: return ImGuiKey_End;
+  case GLFW_KEY_INSERT: return ImGuiKey_Insert;
+  case GLFW_KEY_DELETE: return ImGuiKey_Delete;
+  case GLFW_KEY_BACKSPACE: return ImGuiKey_Backspace;
+  case GLFW_KEY_SPACE: return ImGuiKey_Space;
+  case GLFW_KEY_ENTER: return ImGuiKey_Enter;
+  case GLFW_KEY_ESCAPE: return ImGuiKey_Escape;
+  case GLFW_KEY_APOSTROPHE: return ImGuiKey_Apostrophe;
+  case GLFW_KEY_COMMA: return ImGuiKey_Comma;
+  case GLFW_KEY_MINUS: return ImGuiKey_Minus;
+  case GLFW_KEY_PERIOD: return ImGuiKey_Period;
+  case GLFW_KEY_SLASH: return ImGuiKey_Slash;
+  case GLFW_KEY_SEMICOLON: return ImGuiKey_Semicolon;
+  case GLFW_KEY_EQUAL: return ImGuiKey_Equal;
+  case GLFW_KEY_LEFT_BRACKET: return ImGuiKey_LeftBracket;
+  case GLFW_KEY_BACKSLASH: return ImGuiKey_Backslash;
+  case GLFW_KEY_RIGHT_BRACKET: return ImGuiKey_RightBracket;
+  case GLFW_KEY_GRAVE_ACCENT: return ImGuiKey_GraveAccent;
+  case GLFW_KEY_CAPS_LOCK: return ImGuiKey_CapsLock;
+  case GLFW_KEY_SCROLL_LOCK: return ImGuiKey_ScrollLock;
+  case GLFW_KEY_NUM_LOCK: return ImGuiKey_NumLock;
+  case GLFW_KEY_PRINT_SCREEN: return ImGuiKey_PrintScreen;
+  case GLFW_KEY_PAUSE: return ImGuiKey_Pause;
+  case GLFW_KEY_KP_DECIMAL: return ImGuiKey_KeypadDecimal;
+  case GLFW_KEY_KP_DIVIDE: return ImGuiKey_KeypadDivide;
+  case GLFW_KEY_KP_MULTIPLY: return ImGuiKey_KeypadMultiply;
+  case GLFW_KEY_KP_SUBTRACT: return ImGuiKey_KeypadSubtract;
+  case GLFW_KEY_KP_ADD: return ImGuiKey_KeypadAdd;
+  case GLFW_KEY_KP_ENTER: return ImGuiKey_KeypadEnter;
+  case GLFW_KEY_KP_EQUAL: return ImGuiKey_KeypadEqual;
+  case GLFW_KEY_LEFT_SHIFT: return ImGuiKey_LeftShift;
+  case GLFW_KEY_LEFT_CONTROL: return ImGuiKey_LeftCtrl;
+  case GLFW_KEY_LEFT_ALT: return ImGuiKey_LeftAlt;
+  case GLFW_KEY_LEFT_SUPER: return ImGuiKey_LeftSuper;
+  case GLFW_KEY_RIGHT_SHIFT: return ImGuiKey_RightShift;
+  case GLFW_KEY_RIGHT_CONTROL: return ImGuiKey_RightCtrl;
+  case GLFW_KEY_RIGHT_ALT: return ImGuiKey_RightAlt;
+  case GLFW_KEY_RIGHT_SUPER: return ImGuiKey_RightSuper;
+  case GLFW_KEY_MENU: return ImGuiKey_Menu;
+  default: return ImGuiKey_None;
+  }
+}
+
+// Main thread only. Letter and digit shortcuts follow the keyboard layout,
+// like the upstream backend does; other keys keep their physical position.
+static ImGuiKey translateKey(int key, int scancode) {
+  if (key >= GLFW_KEY_KP_0 && key <= GLFW_KEY_KP_EQUAL) {
+    return translateKey(key);
+  }
+  const char *name = glfwGetKeyName(key, scancode);
+  if (name && name[0] != 0 && name[1] == 0) {
+    const char c = name[0];
+    if (c >= '0' && c <= '9') {
+      key = GLFW_KEY_0 + (c - '0');
+    } else if (c >= 'A' && c <= 'Z') {
+      key = GLFW_KEY_A + (c - 'A');
+    } else if (c >= 'a' && c <= 'z') {
+      key = GLFW_KEY_A + (c - 'a');
+    }
+  }
+  return translateKey(key);
+}
+
+void InputQueue::attach(GLFWwindow *newWindow) {
+  window = newWindow;
+  glfwSetWindowUserPointer(window, this);
+  glfwSetCursorPosCallback(window, cursorPosCallback);
+  glfwSetMouseButtonCallback(window, mouseButtonCallback);
+  glfwSetScrollCallback(window, scrollCallback);
+  glfwSetKeyCallback(window, keyCallback);
+  glfwSetCharCallback(window, charCallback);
+  glfwSetWindowSizeCallback(window, windowSizeCallback);
+  glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+  glfwSetWindowFocusCallback(window, focusCallback);
+  glfwSetWindowCloseCallback(window, closeCallback);
+
+  // The backend's clipboard hooks call GLFW from whichever thread runs
+  // ImGui; use ImGui's own clipboard instead.
+  ImGuiIO &io = ImGui::GetIO();
+  io.GetClipboardTextFn = NULL;
+  io.SetClipboardTextFn = NULL;
+  // Keys are submitted with io.AddKeyEvent(), which ImGui refuses to mix
+  // with the legacy key map the backend filled in.
+  for (int i = 0; i < ImGuiKey_COUNT; i++) {
+    io.KeyMap[i] = -1;
+  }
+
+  int width, height;
+  glfwGetWindowSize(window, &width, &height);
+  windowSizeCallback(window, width, height);
+  glfwGetFramebufferSize(window, &width, &height);
+  framebufferSizeCallback(window, width, height);
+  double x, y;
+  glfwGetCursorPos(window, &x, &y);
+  cursorPosCallback(window, x, y);
+  focusCallback(window, glfwGetWindowAttrib(window, GLFW_FOCUSED));
+}
+
+void InputQueue::push(const InputEvent &event) {
+  if (!events.push(event)) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+  // Pairs with the fence in waitForEvents(): either the render thread sees
+  // the event, or this thread sees it waiting.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (waiting.load(std::memory_order_relaxed)) {
+    std::lock_guard<std::mutex> lock(waitMutex);
+    waitCondition.notify_one();
+  }
+}
+
+void InputQueue::waitForEvents(double timeout) {
+  std::unique_lock<std::mutex> lock(waitMutex);
+  waiting.store(true, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  waitCondition.wait_for(lock, std::chrono::duration<double>(timeout),
+                         [this] { return !events.empty(); });
+  waiting.store(false, std::memory_order_relaxed);
+}
+
+void InputQueue::cursorPosCallback(GLFWwindow *window, double x, double y) {
+  const float packed[2] = {(float)x, (float)y};
+  uint64_t bits;
+  memcpy(&bits, packed, sizeof(bits));
+  queueOf(window)->cursor.store(bits, std::memory_order_relaxed);
+
+  InputEvent event;
+  event.type = InputEvent::CURSOR_POS;
+  event.x = x;
+  event.y = y;
+  queueOf(window)->push(event);
+}
+
+void InputQueue::mouseButtonCallback(GLFWwindow *window, int button,
+                                     int action, int mods) {
+  InputEvent event;
+  event.type = InputEvent::MOUSE_BUTTON;
+  event.a = button;
+  event.c = action;
+  event.d = mods;
+  queueOf(window)->push(event);
+}
+
+void InputQueue::scrollCallback(GLFWwindow *window, double x, double y) {
+  InputEvent event;
+  event.type = InputEvent::SCROLL;
+  event.x = x;
+  event.y = y;
+  queueOf(window)->push(event);
+}
+
+void InputQueue::keyCallback(GLFWwindow *window, int key, int scancode,
+                             int action, int mods) {
+  // Translated here: glfwGetKeyName() may only be called on this thread.
+  InputEvent event;
+  event.type = InputEvent::KEY;
+  event.a = translateKey(key, scancode);
+  event.b = key;
+  event.c = action;
+  event.d = mods;
+  queueOf(window)->push(event);
+}
+
+void InputQueue::charCallback(GLFWwindow *window, unsigned int codepoint) {
+  InputEvent event;
+  event.type = InputEvent::CHAR;
+  event.a = (int)codepoint;
+  queueOf(window)->push(event);
+}
+
+void InputQueue::windowSizeCallback(GLFWwindow *window, int width,
+                                    int height) {
+  InputEvent event;
+  event.type = InputEvent::WINDOW_SIZE;
+  event.a = width;
+  event.b = height;
+  queueOf(window)->push(event);
+}
+
+void InputQueue::framebufferSizeCallback(GLFWwindow *window, int width,
+                                         int height) {
+  InputEvent event;
+  event.type = InputEvent::FRAMEBUFFER_SIZE;
+  event.a = width;
+  event.b = height;
+  queueOf(window)->push(event);
+}
+
+void InputQueue::focusCallback(GLFWwindow *window, int focused) {
+  InputEvent event;
+  event.type = InputEvent::FOCUS;
+  event.a = focused;
+  queueOf(window)->push(event);
+}
+
+void InputQueue::closeCallback(GLFWwindow *window) {
+  InputEvent event;
+  event.type = InputEvent::CLOSE;
+  queueOf(window)->push(event);
+}
+
+void InputQueue::latestCursor(float &x, float &y) const {
+  const uint64_t bits = cursor.load(std::memory_order_relaxed);
+  float packed[2];
+  memcpy(packed, &bits, sizeof(bits));
+  x = packed[0];
+  y = packed[1];
+}
+
+int InputQueue::dispatch() {
+  ImGuiIO &io = ImGui::GetIO();
+  int count = 0;
+  InputEvent event;
+  while (events.pop(event)) {
+    count++;
+    switch (event.type) {
+    case InputEvent::CURSOR_POS:
+      inputState.cursorX = event.x;
+      inputState.cursorY = event.y;
+      break;
+    case InputEvent::MOUSE_BUTTON:
+      if (event.a >= 0 && event.a < InputState::MOUSE_BUTTONS) {
+        inputState.mouseDown[event.a] = event.c == GLFW_PRESS;
+        if (event.c == GLFW_PRESS) {
+          inputState.mousePressed[event.a] = true;
+        }
+      }
+      break;
+    case InputEvent::SCROLL:
+      io.AddMouseWheelEvent((float)event.x, (float)event.y);
+      break;
+    case InputEvent::KEY:
+      // The modifiers as of the event, not as of now.
+      io.AddKeyEvent(ImGuiMod_Ctrl, (event.d & GLFW_MOD_CONTROL) != 0);
+      io.AddKeyEvent(ImGuiMod_Shift, (event.d & GLFW_MOD_SHIFT) != 0);
+      io.AddKeyEvent(ImGuiMod_Alt, (event.d & GLFW_MOD_ALT) != 0);
+      io.AddKeyEvent(ImGuiMod_Super, (event.d & GLFW_MOD_SUPER) != 0);
+      if (event.a != ImGuiKey_None && event.c != GLFW_REPEAT) {
+        io.AddKeyEvent((ImGuiKey)event.a, event.c == GLFW_PRESS);
+        io.SetKeyEventNativeData((ImGuiKey)event.a, event.b, 0);
+      }
+      break;
+    case InputEvent::CHAR:
+      io.AddInputCharacter((unsigned int)event.a);
+      break;
+    case InputEvent::WINDOW_SIZE:
+      inputState.windowWidth = event.a;
+      inputState.windowHeight = event.b;
+      break;
+    case InputEvent::FRAMEBUFFER_SIZE:
+      inputState.framebufferWidth = event.a;
+      inputState.framebufferHeight = event.b;
+      break;
+    case InputEvent::FOCUS:
+      inputState.focused = event.a != 0;
+      break;
+    case InputEvent::CLOSE:
+      inputState.closeRequested = true;
+      break;
+    }
+  }
+  return count;
+}
+
+void InputQueue::newImGuiFrame() {
+  ImGuiIO &io = ImGui::GetIO();
+  const int width = inputState.windowWidth;
+  const int height = inputState.windowHeight;
+  io.DisplaySize = ImVec2((float)width, (float)height);
+  if (width > 0 && height > 0) {
+    io.DisplayFramebufferScale =
+        ImVec2((float)inputState.framebufferWidth / width,
+               (float)inputState.framebufferHeight / height);
+  }
+
+  // glfwGetTime() is the one GLFW query safe on any thread.
+  const double now = glfwGetTime();
+  io.DeltaTime =
+      lastFrameTime > 0.0 ? (float)(now - lastFrameTime) : 1.0f / 60.0f;
+  lastFrameTime = now;
+
+  for (int i = 0; i < InputState::MOUSE_BUTTONS; i++) {
+    io.MouseDown[i] = inputState.mouseDown[i] || inputState.mousePressed[i];
+    inputState.mousePressed[i] = false;
+  }
+  if (inputState.focused) {
+    io.MousePos =
+        ImVec2((float)inputState.cursorX, (float)inputState.cursorY);
+  } else {
+    io.MousePos = ImVec2(-FLT_MAX, -FLT_MAX);
+  }
+}
@@ -0,0 +1,183 @@
+#include <job_system.h>
+
+#include <algorithm>
+#include <string>
+
+#include <perf_counters.h>
+#include <profiler.h>
+
+// Index of the worker running on this thread, -1 on other threads.
+static thread_local int currentWorker = -1;
+
+JobSystem::JobSystem(int workerCount) {
+  if (workerCount <= 0) {
+    workerCount = std::max((int)std::thread::hardware_concurrency() - 1, 1);
+  }
+  for (int i = 0; i < workerCount; i++) {
+    workers.push_back(std::make_unique<Worker>());
+  }
+  for (int i = 0; i < workerCount; i++) {
+    workers[i]->thread = std::thread(&JobSystem::workerThreadFunc, this, i);
+  }
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    stopping = true;
+  }
+  sleepCondition.notify_all();
+  for (auto &worker : workers) {
+    worker->thread.join();
+  }
+}
+
+void JobSystem::submit(std::function<void()> function, JobGroup *group) {
+  if (group) {
+    group->pending.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  const int index =
+      currentWorker >= 0
+          ? currentWorker
+          : (int)(nextWorker.fetch_add(1, std::memory_order_relaxed) %
+                  workers.size());
+  {
+    std::lock_guard<std::mutex> lock(workers[index]->mutex);
+    workers[index]->jobs.push_back({std::move(function), group});
+  }
+  queuedJobs.fetch_add(1, std::memory_order_release);
+
+  // Taking the lock orders the wake-up after a sleeper's predicate check.
+  { std::lock_guard<std::mutex> lock(sleepMutex); }
+  sleepCondition.notify_one();
+}
+
+bool JobSystem::popOrSteal(int index, Job &job) {
+  if (queuedJobs.load(std::memory_order_acquire) == 0) {
+    return false;
+  }
+
+  // Own deque first, newest job (likely still in cache).
+  if (index >= 0) {
+    Worker &own = *workers[index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.jobs.empty()) {
+      job = std::move(own.jobs.back());
+      own.jobs.pop_back();
+      queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+
+  // Steal the oldest job of another worker.
+  const int count = (int)workers.size();
+  const int start = index >= 0 ? index + 1 : 0;
+  for (int i = 0; i < count; i++) {
+    Worker &victim = *workers[(start + i) % count];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.jobs.empty()) {
+      job = std::move(victim.jobs.front());
+      victim.jobs.pop_front();
+      queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+  return false;
+}
+
+void JobSystem::run(Job &job) {
+  {
+    PROFILE_ZONE("job");
+    job.function();
+  }
+  if (job.group) {
+    job.group->pending.fetch_sub(1, std::memory_order_release);
+  }
+}
+
+void JobSystem::workerThreadFunc(int index) {
+  currentWorker = index;
+  const std::string name = "job" + std::to_string(index);
+  setProfilerThreadName(name.c_str());
+  registerPerfCounterThread(name);
+
+  Job job;
+  while (true) {
+    if (popOrSteal(index, job)) {
+      run(job);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleepMutex);
+    sleepCondition.wait(lock, [this] {
+      return stopping || queuedJobs.load(std::memory_order_acquire) > 0;
+    });
+    if (stopping) {
+      return;
+    }
+  }
+}
+
+void JobSystem::wait(JobGroup &group) {
+  Job job;
+  while (!group.done()) {
+    if (popOrSteal(currentWorker, job)) {
+      run(job);
+    } else {
+      // The remaining jobs are running on other threads.
+      std::this_thread::yield();
+    }
+  }
+}
+
+// Chunks are handed out through a shared counter instead of one job each.
+// The caller only ever runs chunks of its own loop, so a long unrelated job
+// queued in the pool cannot stall it, and helpers that start after the loop
+// finished find nothing left and return without touching body.
+struct ParallelLoop {
+  std::atomic<int> next{0};
+  std::atomic<int> finished{0};
+  int count = 0;
+  int grainSize = 1;
+  const std::function<void(int, int)> *body = nullptr;
+
+  void run() {
+    while (true) {
+      const int begin = next.fetch_add(grainSize, std::memory_order_relaxed);
+      if (begin >= count) {
+        return;
+      }
+      const int end = std::min(begin + grainSize, count);
+      (*body)(begin, end);
+      finished.fetch_add(end - begin, std::memory_order_release);
+    }
+  }
+};
+
+void JobSystem::parallelFor(int count, int grainSize,
+                            const std::function<void(int, int)> &body) {
+  if (count <= 0) {
+    return;
+  }
+  auto loop = std::make_shared<ParallelLoop>();
+  loop->count = count;
+  loop->grainSize = std::max(grainSize, 1);
+  loop->body = &body;
+
+  const int chunks = (count + loop->grainSize - 1) / loop->grainSize;
+  const int helpers = std::min(chunks - 1, workerCount());
+  for (int i = 0; i < helpers; i++) {
+    submit([loop] { loop->run(); });
+  }
+  loop->run();
+  // Chunks other threads picked up may still be running.
+  while (loop->finished.load(std::memory_order_acquire) < count) {
+    std::this_thread::yield();
+  }
+}
+
+JobSystem &jobSystem() {
+  static JobSystem instance;
+  return instance;
+}
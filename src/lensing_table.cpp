@@ -0,0 +1,189 @@
+#include <lensing_table.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <gl_stats.h>
+#include <profiler.h>
+
+static const double PI = 3.14159265358979;
+// Impact parameter of the photon sphere, 3 * sqrt(3) / 2 horizon radii.
+static const double CRITICAL_IMPACT = 2.598076211;
+// Rays traced per camera distance on each side of the critical one. They
+// crowd exponentially toward it, where the secondary images come from.
+static const int RAYS_PER_SIDE = 2048;
+static const double RAY_CROWDING = 16.0;
+static const int SUBSTEPS = 4;
+// The magnification diverges on the Einstein ring.
+static const float MAX_MAGNIFICATION = 8.0f;
+
+// 0 at t = 0, 1 at t = 1, exponentially denser toward 0.
+static double crowd(double t) {
+  return (exp(RAY_CROWDING * t) - 1.0) / (exp(RAY_CROWDING) - 1.0);
+}
+
+static double lerp(double a, double b, double t) { return a + (b - a) * t; }
+
+// One RK4 step of u'' = 1.5 u^2 - u, u = 1 / r, over the orbit angle.
+static void step(double &u, double &w, double h) {
+  auto accel = [](double u) { return 1.5 * u * u - u; };
+  const double k1u = w, k1w = accel(u);
+  const double k2u = w + 0.5 * h * k1w, k2w = accel(u + 0.5 * h * k1u);
+  const double k3u = w + 0.5 * h * k2w, k3w = accel(u + 0.5 * h * k2u);
+  const double k4u = w + h * k3w, k4w = accel(u + h * k3u);
+  u += h / 6.0 * (k1u + 2.0 * k2u + 2.0 * k3u + k4u);
+  w += h / 6.0 * (k1w + 2.0 * k2w + 2.0 * k3w + k4w);
+}
+
+LensingTable::~LensingTable() {
+  if (building) {
+    jobSystem().wait(group);
+  }
+  if (tableTexture) {
+    glDeleteTextures(1, &tableTexture);
+  }
+}
+
+void LensingTable::build() {
+  if (building || tableTexture) {
+    return;
+  }
+  table.assign((size_t)CAMERA_SIZE * RADIUS_SIZE * PSI_SIZE * 4, -1.0f);
+  building = true;
+  for (int i = 0; i < CAMERA_SIZE; i++) {
+    jobSystem().submit([this, i] { buildSlice(i); }, &group);
+  }
+}
+
+GLuint LensingTable::texture() {
+  if (tableTexture || !building || !group.done()) {
+    return tableTexture;
+  }
+  glGenTextures(1, &tableTexture);
+  glBindTexture(GL_TEXTURE_3D, tableTexture);
+  glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, PSI_SIZE, RADIUS_SIZE,
+               CAMERA_SIZE, 0, GL_RGBA, GL_FLOAT, table.data());
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_3D, 0);
+
+  std::vector<float>().swap(table);
+  building = false;
+  return tableTexture;
+}
+
+void LensingTable::buildSlice(int cameraIndex) {
+  PROFILE_ZONE("lensingTableSlice");
+  const double cameraDistance =
+      lerp(MIN_CAMERA_DISTANCE, MAX_CAMERA_DISTANCE,
+           (double)cameraIndex / (CAMERA_SIZE - 1));
+  const double criticalAngle = asin(CRITICAL_IMPACT / cameraDistance);
+
+  // Angles between the ray leaving the camera and the direction to the
+  // hole, increasing. Radial and outward-only rays are left out.
+  std::vector<double> angles;
+  for (int k = RAYS_PER_SIDE - 1; k >= 1; k--) {
+    angles.push_back(criticalAngle *
+                     (1.0 - crowd((double)k / RAYS_PER_SIDE)));
+  }
+  for (int k = 1; k < RAYS_PER_SIDE; k++) {
+    angles.push_back(criticalAngle + (PI - criticalAngle) *
+                                         crowd((double)k / RAYS_PER_SIDE));
+  }
+  const int rayCount = (int)angles.size();
+
+  // Radius of every ray at orbit angles 0..2pi in table steps: 0 once
+  // captured, infinity once escaped. At a fixed orbit angle the radius
+  // grows with the ray angle, which makes the inversion a binary search.
+  const int PHI_SIZE = 2 * PSI_SIZE - 1;
+  const double phiStep = PI / (PSI_SIZE - 1);
+  const float INF = std::numeric_limits<float>::infinity();
+  std::vector<float> radii((size_t)rayCount * PHI_SIZE);
+  for (int k = 0; k < rayCount; k++) {
+    float *r = &radii[(size_t)k * PHI_SIZE];
+    double u = 1.0 / cameraDistance;
+    double w = u / tan(angles[k]);
+    r[0] = (float)cameraDistance;
+    int j = 1;
+    float fill = 0.0f;
+    for (; j < PHI_SIZE; j++) {
+      for (int s = 0; s < SUBSTEPS; s++) {
+        step(u, w, phiStep / SUBSTEPS);
+      }
+      if (u >= 1.0) {
+        break;
+      }
+      if (u <= 0.0 || (w < 0.0 && u < 1.0 / MAX_RADIUS)) {
+        fill = INF;
+        break;
+      }
+      r[j] = (float)(1.0 / u);
+    }
+    std::fill(r + j, r + PHI_SIZE, fill);
+  }
+
+  // Ray angle reaching radius at orbit angle phi, or -1.
+  auto invert = [&](int phi, double radius) -> float {
+    int low = 0, high = rayCount;
+    while (low < high) {
+      const int mid = (low + high) / 2;
+      if (radii[(size_t)mid * PHI_SIZE + phi] < radius) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    if (low == 0 || low == rayCount) {
+      return -1.0f;
+    }
+    const float r0 = radii[(size_t)(low - 1) * PHI_SIZE + phi];
+    const float r1 = radii[(size_t)low * PHI_SIZE + phi];
+    if (r0 <= 0.0f || std::isinf(r1)) {
+      return (float)angles[low];
+    }
+    return (float)lerp(angles[low - 1], angles[low],
+                       (radius - r0) / (r1 - r0));
+  };
+
+  for (int i = 0; i < RADIUS_SIZE; i++) {
+    const double radius =
+        lerp(MIN_RADIUS, MAX_RADIUS, (double)i / (RADIUS_SIZE - 1));
+    float *row =
+        &table[((size_t)cameraIndex * RADIUS_SIZE + i) * PSI_SIZE * 4];
+    for (int j = 0; j < PSI_SIZE; j++) {
+      row[j * 4 + 0] = invert(j, radius);
+      row[j * 4 + 2] = invert(PHI_SIZE - 1 - j, radius);
+    }
+    // On the axis every ray starts at the camera.
+    row[0] = radius < cameraDistance ? 0.0f : (float)PI;
+
+    // Magnification of a point source, (sin a / sin a0) * (da / da0) with
+    // a0 the unlensed angle, from differences along psi.
+    auto unlensed = [&](int j) {
+      const double psi = j * phiStep;
+      return atan2(radius * sin(psi), cameraDistance - radius * cos(psi));
+    };
+    for (int image = 0; image < 2; image++) {
+      float *angle = row + image * 2;
+      float *magnification = row + image * 2 + 1;
+      for (int j = 1; j < PSI_SIZE - 1; j++) {
+        const float a = angle[j * 4], before = angle[(j - 1) * 4],
+                    after = angle[(j + 1) * 4];
+        if (a < 0.0f || before < 0.0f || after < 0.0f) {
+          magnification[j * 4] = 0.0f;
+          continue;
+        }
+        const double a0 = unlensed(j);
+        const double da0 = unlensed(j + 1) - unlensed(j - 1);
+        const double m = fabs(sin(a) * (after - before) / (sin(a0) * da0));
+        magnification[j * 4] = (float)std::min(m, (double)MAX_MAGNIFICATION);
+      }
+      magnification[0] = magnification[4];
+      magnification[(PSI_SIZE - 1) * 4] = magnification[(PSI_SIZE - 2) * 4];
+    }
+  }
+}
@@ -1,6 +1,6 @@
 /**
  * @file main.cpp
- * @brief Real-time black hole rendering in OpenGL with OpenMP for simulation parallelism.
+ * @brief Real-time black hole rendering in OpenGL.
  * @version 0.1
  * @date 2020-08-29
  *
@@ -8,21 +8,21 @@
  *
  */
 
+ #include <algorithm>
  #include <assert.h>
  #include <map>
  #include <stdio.h>
  #include <vector>
- #include <thread>
  #include <atomic>
  #include <chrono>
  #include <cmath>
+ #include <cstring>
+ #include <memory>
  #include <queue>
  #include <functional>
  #include <condition_variable>
- 
- // Include OpenMP header.
- #include <omp.h>
- 
+ #include <thread>
+  
  #include <GL/glew.h>
  #include <GLFW/glfw3.h>
  #include <glm/glm.hpp>
@@ -32,11 +32,30 @@
  #include <imgui.h>
  
  #include <GLDebugMessageCallback.h>
+ #include <benchmark.h>
+ #include <cost_heatmap.h>
+ #include <dynamic_resolution.h>
+ #include <frame_clock.h>
+ #include <frame_pacer.h>
+ #include <gl_stats.h>
+ #include <gpu_timer.h>
+ #include <profiler.h>
+ #include <quality_tuner.h>
  #include <imgui_impl_glfw.h>
  #include <imgui_impl_opengl3.h>
+ #include <input_queue.h>
+ #include <job_system.h>
+ #include <lensing_table.h>
+ #include <perf_counters.h>
  #include <render.h>
+ #include <particle_renderer.h>
+ #include <render_target_pool.h>
+ #include <simulation.h>
  #include <shader.h>
+ #include <telemetry.h>
  #include <texture.h>
+ #include <virtual_texture.h>
+ #include <work_counters.h>
  
  #include "stats_overlay.h"
  
@@ -58,46 +77,15 @@
    ImGui::SliderFloat(#NAME, &NAME, MIN, MAX);      \
    rtti.floatUniforms[#NAME] = NAME;
  
- // Use a lock-free atomic for the simulation parameter.
- std::atomic<float> simulationParam {0.0f}; // Updated by the simulation thread.
- bool simulationRunning = true;
+ // Storage formats offered for intermediate render targets. Packed float
+ // halves the bandwidth of RGB16F at about 6 bits of mantissa; 8-bit is only
+ // for values already in display range.
+ static const char *TARGET_FORMAT_ITEMS[] = {"RGB16F", "R11G11B10F", "RGBA8"};
+ static const GLenum TARGET_FORMATS[] = {GL_RGB16F, GL_R11F_G11F_B10F, GL_RGBA8};
  
- // -----------------------------------------------------------------------------
- // Simulation Thread Function Using OpenMP
- // -----------------------------------------------------------------------------
- void simulationThreadFunc() {
-     using namespace std::chrono;
-     auto lastTime = steady_clock::now();
-     while (simulationRunning) {
-         auto now = steady_clock::now();
-         duration<float> delta = now - lastTime;
-         lastTime = now;
-         float dt = delta.count();
-         float speed = 0.5f; // simulation speed factor
- 
-         // Atomically update the simulation parameter.
-         float current = simulationParam.load(std::memory_order_relaxed);
-         float newVal = current + dt * speed;
-         if (newVal > 6.28318f) // wrap around 2*pi
-             newVal -= 6.28318f;
-         simulationParam.store(newVal, std::memory_order_relaxed);
- 
-         // Capture current simulation parameter for computation.
-         float sp = simulationParam.load(std::memory_order_relaxed);
- 
-         // Heavy computation loop parallelized with OpenMP.
-         const int iterations = 1000000; // total iterations
-         double result = 0.0;
- #pragma omp parallel for reduction(+:result)
-         for (int i = 0; i < iterations; i++) {
-             result += sin(i * sp);
-         }
-         // Use volatile to prevent compiler optimization of dummy computation.
-         volatile double dummy = result;
- 
-         std::this_thread::sleep_for(milliseconds(10));
-     }
- }
+ #define IMGUI_FORMAT(NAME, DEFAULT)             \
+   static int NAME = DEFAULT;                    \
+   ImGui::Combo(#NAME, &NAME, TARGET_FORMAT_ITEMS, IM_ARRAYSIZE(TARGET_FORMAT_ITEMS));
  
  // -----------------------------------------------------------------------------
  // GLFW Error Callback
@@ -106,20 +94,6 @@
      fprintf(stderr, "Glfw Error %d: %s\n", error, description);
  }
  
- // -----------------------------------------------------------------------------
- // Mouse Callback
- // -----------------------------------------------------------------------------
- void mouseCallback(GLFWwindow *window, double x, double y) {
-     static float lastX = 400.0f;
-     static float lastY = 300.0f;
-     static float yaw = 0.0f;
-     static float pitch = 0.0f;
-     static float firstMouse = true;
- 
-     mouseX = (float)x;
-     mouseY = (float)y;
- }
- 
  // -----------------------------------------------------------------------------
  // PostProcessPass Class for Rendering
  // -----------------------------------------------------------------------------
@@ -136,9 +110,11 @@
          glUseProgram(0);
      }
  
-     void render(GLuint inputColorTexture, GLuint destFramebuffer = 0) {
+     void render(GLuint inputColorTexture, int width, int height,
+                 GLuint destFramebuffer = 0) {
          glBindFramebuffer(GL_FRAMEBUFFER, destFramebuffer);
  
+         glViewport(0, 0, width, height);
          glDisable(GL_DEPTH_TEST);
  
          glClearColor(1.0f, 0.0f, 0.0f, 1.0f);
@@ -147,10 +123,10 @@
          glUseProgram(this->program);
  
          glUniform2f(glGetUniformLocation(this->program, "resolution"),
-                     (float)SCR_WIDTH, (float)SCR_HEIGHT);
+                     (float)width, (float)height);
  
          glUniform1f(glGetUniformLocation(this->program, "time"),
-                     (float)glfwGetTime());
+                     (float)getFrameTime());
  
          glActiveTexture(GL_TEXTURE0);
          glBindTexture(GL_TEXTURE_2D, inputColorTexture);
@@ -164,22 +140,113 @@
  // -----------------------------------------------------------------------------
  // Main Function
  // -----------------------------------------------------------------------------
- int main(int, char **) {
+ int main(int argc, char **argv) {
+     // Command line options.
+     std::string panoramaFile;
+     bool tuneQuality = false;
+     bool headless = false;
+     int frameLimit = 100;
+     std::string benchmarkPath;
+     std::string benchmarkOutput = "benchmark.json";
+     std::string gpuTimingLog;
+     std::string cpuTraceFile;
+     bool perfCounters = false;
+     bool countGpuWork = false;
+     double benchmarkTimeStep = 1.0 / 60.0;
+     double simulationRate = 60.0;
+     int particleCount = 1 << 18;
+     PacingMode pacingMode = PacingMode::VSYNC;
+     bool pacingModeSet = false;
+     float fpsCap = 60.0f;
+     int windowWidth = SCR_WIDTH;
+     int windowHeight = SCR_HEIGHT;
+     for (int i = 1; i < argc; i++) {
+         if (!strcmp(argv[i], "--panorama") && i + 1 < argc) {
+             panoramaFile = argv[++i];
+         } else if (!strcmp(argv[i], "--headless")) {
+             headless = true;
+         } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+             frameLimit = atoi(argv[++i]);
+         } else if (!strcmp(argv[i], "--benchmark") && i + 1 < argc) {
+             benchmarkPath = argv[++i];
+         } else if (!strcmp(argv[i], "--output") && i + 1 < argc) {
+             benchmarkOutput = argv[++i];
+         } else if (!strcmp(argv[i], "--timestep") && i + 1 < argc) {
+             benchmarkTimeStep = atof(argv[++i]);
+         } else if (!strcmp(argv[i], "--sim-rate") && i + 1 < argc) {
+             simulationRate = std::max(atof(argv[++i]), 1.0);
+         } else if (!strcmp(argv[i], "--particles") && i + 1 < argc) {
+             particleCount = std::max(atoi(argv[++i]), 0);
+         } else if (!strcmp(argv[i], "--pacing") && i + 1 < argc &&
+                    parsePacingMode(argv[i + 1], pacingMode)) {
+             pacingModeSet = true;
+             i++;
+         } else if (!strcmp(argv[i], "--fps-cap") && i + 1 < argc) {
+             fpsCap = std::max((float)atof(argv[++i]), 1.0f);
+         } else if (!strcmp(argv[i], "--gpu-log") && i + 1 < argc) {
+             gpuTimingLog = argv[++i];
+         } else if (!strcmp(argv[i], "--profile") && i + 1 < argc) {
+             cpuTraceFile = argv[++i];
+         } else if (!strcmp(argv[i], "--perf-counters")) {
+             perfCounters = true;
+         } else if (!strcmp(argv[i], "--work-counters")) {
+             countGpuWork = true;
+         } else if (!strcmp(argv[i], "--size") && i + 1 < argc &&
+                    sscanf(argv[i + 1], "%dx%d", &windowWidth, &windowHeight) == 2) {
+             i++;
+         } else if (!strcmp(argv[i], "--tune")) {
+             tuneQuality = true;
+         } else if (!strcmp(argv[i], "--build-panorama") && i + 2 < argc) {
+             // Offline conversion, no window needed.
+             return buildVirtualTextureFile(argv[i + 1], argv[i + 2]) ? 0 : 1;
+         } else {
+             fprintf(stderr, "Usage: %s [--panorama file.vt] [--tune] "
+                             "[--headless] [--frames N] [--size WxH] "
+                             "[--benchmark camera_path.txt [--output file.json] "
+                             "[--timestep seconds]] [--sim-rate hz] [--particles N] "
+                             "[--pacing vsync|adaptive|capped|uncapped] [--fps-cap fps] "
+                             "[--gpu-log passes.csv] "
+                             "[--profile trace.json] [--perf-counters] "
+                             "[--work-counters] "
+                             "[--build-panorama image file.vt]\n", argv[0]);
+             return 1;
+         }
+     }
+ 
      // Setup window
      glfwSetErrorCallback(glfwErrorCallback);
+     if (headless) {
+         // No display server: GLFW's null platform with an EGL surfaceless
+         // context (Mesa llvmpipe on CPU-only machines), or OSMesa.
+         glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+     }
      if (!glfwInit())
          return 1;
  
-     glfwWindowHint(GLFW_DECORATED, GLFW_FALSE);
-     GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Wormhole", NULL, NULL);
+     GLFWwindow *window = NULL;
+     if (headless) {
+         glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+         glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+         window = glfwCreateWindow(windowWidth, windowHeight, "Wormhole", NULL, NULL);
+         if (window == NULL) {
+             glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+             window = glfwCreateWindow(windowWidth, windowHeight, "Wormhole", NULL, NULL);
+         }
+     } else {
+         glfwWindowHint(GLFW_DECORATED, GLFW_FALSE);
+         window = glfwCreateWindow(windowWidth, windowHeight, "Wormhole", NULL, NULL);
+     }
      if (window == NULL)
          return 1;
      glfwMakeContextCurrent(window);
-     glfwSwapInterval(1); // Enable vsync
-     glfwSetCursorPosCallback(window, mouseCallback);
-     glfwSetWindowPos(window, 0, 0);
- 
-     bool err = glewInit() != GLEW_OK;
+     if (!headless)
+         glfwSetWindowPos(window, 0, 0);
+ 
+     // GLEW also probes GLX after loading the GL entry points, which fails
+     // without an X display; the context itself is usable.
+     GLenum glewStatus = glewInit();
+     bool err = glewStatus != GLEW_OK &&
+                !(headless && glewStatus == GLEW_ERROR_NO_GLX_DISPLAY);
      if (err) {
          fprintf(stderr, "Failed to initialize OpenGL loader!\n");
          return 1;
@@ -210,7 +277,8 @@
  
          ImGui::StyleColorsDark();
  
-         ImGui_ImplGlfw_InitForOpenGL(window, true);
+         // Input reaches ImGui through the InputQueue below.
+         ImGui_ImplGlfw_InitForOpenGL(window, false);
          ImGui_ImplOpenGL3_Init(glsl_version);
  
          bool show_demo_window = true;
@@ -218,160 +286,697 @@
          ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
      }
  
-     // Start the simulation thread using OpenMP parallelism.
-     std::thread simulationThread(simulationThreadFunc);
+     // Window events are pumped on this thread and rendered on the render
+     // thread, which owns the GL context; headless runs do both here.
+     const bool renderThreaded = !headless;
+     InputQueue input;
+     input.attach(window);
  
-     GLuint fboBlackhole, texBlackhole;
-     texBlackhole = createColorTexture(SCR_WIDTH, SCR_HEIGHT);
+     // CPU zones for the whole run with --profile, otherwise captured on
+     // demand from the UI.
+     setProfilerThreadName("main");
+     if (!cpuTraceFile.empty())
+         startProfilerCapture();
  
-     FramebufferCreateInfo info = {};
-     info.colorTexture = texBlackhole;
-     if (!(fboBlackhole = createFramebuffer(info))) {
-         assert(false);
-     }
+     // Hardware counters for the render thread, the job system workers and
+     // the panorama streaming thread, if any.
+     if (perfCounters && enablePerfCounters())
+         registerPerfCounterThread("main");
+ 
+     // Worker pool shared by all CPU-side work, e.g. texture decoding.
+     // Started after the counters are enabled so that the workers register.
+     jobSystem();
+ 
+     // Render targets are sized from the framebuffer every frame and
+     // reallocated when the window is resized.
+     RenderTargetPool renderTargets;
  
      GLuint quadVAO = createQuadVAO();
      glBindVertexArray(quadVAO);
  
      PostProcessPass passthrough("shader/passthrough.frag");
  
-     while (!glfwWindowShouldClose(window)) {
-         glfwPollEvents();
+     // GPU pass timing feeding the dynamic resolution controller and the
+     // stats overlay. Every renderToTexture() call is timed as its own pass.
+     std::unique_ptr<GpuTimer> gpuTimer(new GpuTimer());
+     setRenderToTextureTimer(gpuTimer.get());
+     if (!gpuTimingLog.empty() && !gpuTimer->openCsvLog(gpuTimingLog)) {
+         std::cout << "ERROR: Failed to open GPU timing log " << gpuTimingLog << std::endl;
+     }
+     DynamicResolution dynamicResolution;
+ 
+     // Steps, disk samples, captured/escaped rays and bloom samples counted
+     // by the shaders themselves; opt-in since every pixel does atomics.
+     std::unique_ptr<GpuWorkCounters> workCounters(new GpuWorkCounters());
+     const bool workCountersSupported = GpuWorkCounters::isSupported();
+     // Per-frame totals for the cost heatmap.
+     std::unique_ptr<CostReduction> costReduction(new CostReduction());
+     if (countGpuWork && !workCountersSupported) {
+         std::cout << "ERROR: GPU work counters need GL_ARB_shader_storage_buffer_object" << std::endl;
+         countGpuWork = false;
+     }
  
-         ImGui_ImplOpenGL3_NewFrame();
-         ImGui_ImplGlfw_NewFrame();
-         ImGui::NewFrame();
+     // Machine specific quality presets written by the tuner.
+     const std::string QUALITY_PRESETS_FILE = "quality_presets.ini";
+     std::map<std::string, QualitySettings> qualityPresets;
+     loadQualityPresets(QUALITY_PRESETS_FILE, qualityPresets);
+     QualityTuner qualityTuner;
+     if (tuneQuality)
+         qualityTuner.start(dynamicResolution.settings.targetFrameMs);
+ 
+     // Benchmark mode: fixed-step clock, scripted camera, fixed frame count,
+     // and every GPU frame recorded.
+     const bool benchmarkMode = !benchmarkPath.empty();
+     CameraPath cameraPath;
+     BenchmarkRecorder benchmarkRecorder;
+     EnergyCounter benchmarkEnergy;
+     if (benchmarkMode) {
+         if (!cameraPath.load(benchmarkPath))
+             return 1;
+         useFixedStepClock(benchmarkTimeStep);
+         if (!benchmarkEnergy.open())
+             std::cout << "WARNING: No readable RAPL energy counters, energy is not recorded" << std::endl;
+         gpuTimer->blocking = true;
+         gpuTimer->onFrameResolved = [&](const std::map<std::string, double> &passTimes) {
+             benchmarkRecorder.recordGpuFrame(passTimes);
+         };
+         workCounters->blocking = true;
+         workCounters->onFrameResolved = [&](const std::map<std::string, double> &counters) {
+             benchmarkRecorder.recordCounters("gpuWorkCounters", counters);
+         };
+         benchmarkRecorder.setInfo("renderer", (const char *)glGetString(GL_RENDERER));
+         benchmarkRecorder.setInfo("cameraPath", benchmarkPath);
+         benchmarkRecorder.setInfo("width", windowWidth);
+         benchmarkRecorder.setInfo("height", windowHeight);
+         benchmarkRecorder.setInfo("frames", frameLimit);
+         benchmarkRecorder.setInfo("timeStep", benchmarkTimeStep);
+         benchmarkRecorder.setInfo("simulationRate", simulationRate);
+         benchmarkRecorder.warmupFrames = std::min(2, frameLimit / 10);
+         benchmarkRecorder.setInfo("warmupFrames", benchmarkRecorder.warmupFrames);
+     }
  
-         int width, height;
-         glfwGetFramebufferSize(window, &width, &height);
-         glViewport(0, 0, width, height);
+     // Optional gigapixel sky panorama streamed through a virtual texture.
+     std::unique_ptr<VirtualTexture> panorama;
+     if (!panoramaFile.empty()) {
+         panorama.reset(new VirtualTexture(panoramaFile));
+         if (!panorama->isValid())
+             panorama.reset();
+     }
  
-         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
- 
-         static GLuint galaxy = loadCubemap("assets/skybox_nebula_dark");
-         static GLuint colorMap = loadTexture2D("assets/color_map.png");
-         static GLuint uvChecker = loadTexture2D("assets/uv_checker.png");
- 
-         static GLuint texBlackhole = createColorTexture(SCR_WIDTH, SCR_HEIGHT);
-         {
-             RenderToTextureInfo rtti;
-             rtti.fragShader = "shader/blackhole_main.frag";
-             rtti.cubemapUniforms["galaxy"] = galaxy;
-             rtti.textureUniforms["colorMap"] = colorMap;
-             rtti.floatUniforms["mouseX"] = mouseX;
-             rtti.floatUniforms["mouseY"] = mouseY;
-             // Removed simulationParam uniform update since it's not used in the shader.
-             rtti.targetTexture = texBlackhole;
-             rtti.width = SCR_WIDTH;
-             rtti.height = SCR_HEIGHT;
- 
-             IMGUI_TOGGLE(gravatationalLensing, true);
-             IMGUI_TOGGLE(renderBlackHole, true);
-             IMGUI_TOGGLE(mouseControl, true);
-             IMGUI_SLIDER(cameraRoll, 0.0f, -180.0f, 180.0f);
-             IMGUI_TOGGLE(frontView, false);
-             IMGUI_TOGGLE(topView, false);
-             IMGUI_TOGGLE(adiskEnabled, true);
-             IMGUI_TOGGLE(adiskParticle, true);
-             IMGUI_SLIDER(adiskDensityV, 2.0f, 0.0f, 10.0f);
-             IMGUI_SLIDER(adiskDensityH, 4.0f, 0.0f, 10.0f);
-             IMGUI_SLIDER(adiskHeight, 0.55f, 0.0f, 1.0f);
-             IMGUI_SLIDER(adiskLit, 0.25f, 0.0f, 4.0f);
-             IMGUI_SLIDER(adiskNoiseLOD, 5.0f, 1.0f, 12.0f);
-             IMGUI_SLIDER(adiskNoiseScale, 0.8f, 0.0f, 10.0f);
-             IMGUI_SLIDER(adiskSpeed, 0.5f, 0.0f, 1.0f);
- 
-             renderToTexture(rtti);
-         }
+     // Camera orbit and disk motion tick on the simulation thread; benchmarks
+     // step them inline from the fixed-step clock so every run is the same.
+     Simulation simulation(simulationRate);
+     simulation.reset(getFrameTime());
+     if (!benchmarkMode)
+         simulation.start();
+     std::unique_ptr<ParticleRenderer> particleRenderer(new ParticleRenderer());
+     // Built in the background the first time lensed particles are shown.
+     std::unique_ptr<LensingTable> lensingTable(new LensingTable());
+ 
+     // Swap interval and frame start times. Headless runs have nothing to
+     // wait for and render as fast as they can unless asked otherwise.
+     GLFWmonitor *monitor = glfwGetPrimaryMonitor();
+     const GLFWvidmode *videoMode = monitor ? glfwGetVideoMode(monitor) : NULL;
+     std::unique_ptr<FramePacer> framePacer(
+         new FramePacer(videoMode ? videoMode->refreshRate : 60.0, !headless));
+     framePacer->settings.mode = headless && !pacingModeSet ? PacingMode::UNCAPPED : pacingMode;
+     framePacer->settings.capFps = fpsCap;
+     if (benchmarkMode)
+         benchmarkRecorder.setInfo("pacing", pacingModeName(framePacer->settings.mode));
+ 
+     // Frames in a row that drew nothing new and saw no input; after a few
+     // the render thread sleeps until the next event.
+     const int IDLE_FRAMES = 3;
+     const double IDLE_TIMEOUT = 0.25;
+     int quietFrames = 0;
+     PassMemoStats memoStats;
+ 
+     int frameCount = 0;
+     const double startTime = glfwGetTime();
+     auto renderLoop = [&]() {
+         while (!input.state().closeRequested &&
+                !((headless || benchmarkMode) && frameCount >= frameLimit)) {
+             framePacer->beginFrame();
+             const auto frameStart = std::chrono::steady_clock::now();
+             PROFILE_ZONE("frame");
+             int eventCount = 0;
+             {
+                 PROFILE_ZONE("poll");
+                 if (!renderThreaded)
+                     glfwPollEvents();
+                 eventCount = input.dispatch();
+             }
  
-         static GLuint texBrightness = createColorTexture(SCR_WIDTH, SCR_HEIGHT);
-         {
-             RenderToTextureInfo rtti;
-             rtti.fragShader = "shader/bloom_brightness_pass.frag";
-             rtti.textureUniforms["texture0"] = texBlackhole;
-             rtti.targetTexture = texBrightness;
-             rtti.width = SCR_WIDTH;
-             rtti.height = SCR_HEIGHT;
-             renderToTexture(rtti);
-         }
+             {
+                 PROFILE_ZONE("imguiNewFrame");
+                 ImGui_ImplOpenGL3_NewFrame();
+                 input.newImGuiFrame();
+                 ImGui::NewFrame();
+             }
  
-         const int MAX_BLOOM_ITER = 8;
-         static GLuint texDownsampled[MAX_BLOOM_ITER];
-         static GLuint texUpsampled[MAX_BLOOM_ITER];
-         if (texDownsampled[0] == 0) {
-             for (int i = 0; i < MAX_BLOOM_ITER; i++) {
-                 texDownsampled[i] = createColorTexture(SCR_WIDTH >> (i + 1), SCR_HEIGHT >> (i + 1));
-                 texUpsampled[i] = createColorTexture(SCR_WIDTH >> i, SCR_HEIGHT >> i);
+             const InputState &inputState = input.state();
+             int width = std::max(inputState.framebufferWidth, 1);
+             int height = std::max(inputState.framebufferHeight, 1);
+             glViewport(0, 0, width, height);
+ 
+             glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+ 
+             CameraKey cameraKey;
+             if (benchmarkMode) {
+                 cameraKey = cameraPath.sample(getFrameTime());
+                 mouseX = cameraKey.mouseX * width;
+                 mouseY = cameraKey.mouseY * height;
              }
-         }
  
-         static int bloomIterations = MAX_BLOOM_ITER;
-         ImGui::SliderInt("bloomIterations", &bloomIterations, 1, 8);
-         for (int level = 0; level < bloomIterations; level++) {
-             RenderToTextureInfo rtti;
-             rtti.fragShader = "shader/bloom_downsample.frag";
-             rtti.textureUniforms["texture0"] = (level == 0 ? texBrightness : texDownsampled[level - 1]);
-             rtti.targetTexture = texDownsampled[level];
-             rtti.width = SCR_WIDTH >> (level + 1);
-             rtti.height = SCR_HEIGHT >> (level + 1);
-             renderToTexture(rtti);
-         }
+             if (benchmarkMode)
+                 simulation.advanceTo(getFrameTime());
+ 
+             // The black hole and bloom passes run at an internal resolution
+             // picked by the frame-time controller; composite and tonemapping
+             // upscale to the framebuffer.
+             gpuTimer->beginFrame();
+             if (workCountersSupported)
+                 ImGui::Checkbox("countGpuWork", &countGpuWork);
+             const bool countWork = countGpuWork && workCounters->beginFrame();
+             static bool dynamicResolutionEnabled = true;
+             ImGui::Checkbox("dynamicResolution", &dynamicResolutionEnabled);
+             ImGui::SliderFloat("targetFrameTime", &dynamicResolution.settings.targetFrameMs,
+                                4.0f, 50.0f, "%.1f ms");
+             int pacingModeIndex = (int)framePacer->settings.mode;
+             const char *pacingModeItems[] = {"vsync", "adaptive vsync", "capped", "uncapped"};
+             if (ImGui::Combo("framePacing", &pacingModeIndex, pacingModeItems,
+                              IM_ARRAYSIZE(pacingModeItems)))
+                 framePacer->settings.mode = (PacingMode)pacingModeIndex;
+             if (framePacer->settings.mode == PacingMode::CAPPED)
+                 ImGui::SliderFloat("fpsCap", &framePacer->settings.capFps, 10.0f, 240.0f, "%.0f");
+             ImGui::Text("Input latency %.1f ms, predicted frame %.1f ms%s",
+                         framePacer->latencyMs(), framePacer->predictedFrameMs(),
+                         framePacer->settings.mode == PacingMode::ADAPTIVE_VSYNC &&
+                                 !framePacer->adaptiveSupported()
+                             ? " (no adaptive vsync, using vsync)"
+                             : "");
+ 
+             // Passes whose inputs did not change are skipped; with time
+             // paused, tuning the post effects only redraws those.
+             static bool pauseTime = false;
+             static bool memoizePasses = true;
+             if (ImGui::Checkbox("pauseTime", &pauseTime))
+                 setFrameClockPaused(pauseTime);
+             ImGui::SameLine();
+             ImGui::Checkbox("memoizePasses", &memoizePasses);
+             setPassMemoization(memoizePasses && !benchmarkMode && !qualityTuner.isRunning());
+             ImGui::Text("Passes drawn %d, skipped %d", memoStats.rendered, memoStats.skipped);
+             {
+                 const auto &transient = renderTargets.transientStats();
+                 ImGui::Text("Post chain %.1f MB resident (%.1f MB unaliased, %d textures)",
+                             transient.allocatedBytes / 1048576.0, transient.unaliasedBytes / 1048576.0,
+                             transient.textures);
+             }
  
-         for (int level = bloomIterations - 1; level >= 0; level--) {
-             RenderToTextureInfo rtti;
-             rtti.fragShader = "shader/bloom_upsample.frag";
-             rtti.textureUniforms["texture0"] = (level == bloomIterations - 1 ? texDownsampled[level] : texUpsampled[level + 1]);
-             rtti.textureUniforms["texture1"] = (level == 0 ? texBrightness : texDownsampled[level - 1]);
-             rtti.targetTexture = texUpsampled[level];
-             rtti.width = SCR_WIDTH >> level;
-             rtti.height = SCR_HEIGHT >> level;
-             renderToTexture(rtti);
-         }
+             // Quality knobs come from the ImGui sliders ("custom"), a tuned
+             // preset, or the tuner while it sweeps.
+             const int MAX_BLOOM_ITER = 8;
+             static int bloomIterationsSetting = MAX_BLOOM_ITER;
+             static int qualityPreset = 0;
+             const char *qualityPresetItems[] = {"custom", "low", "medium", "high", "ultra"};
+             ImGui::Combo("qualityPreset", &qualityPreset, qualityPresetItems,
+                          IM_ARRAYSIZE(qualityPresetItems));
+             if (!isProfilerCapturing()) {
+                 if (ImGui::Button("captureCpuTrace"))
+                     startProfilerCapture();
+             } else if (ImGui::Button("writeCpuTrace")) {
+                 const std::string file = cpuTraceFile.empty() ? "cpu_trace.json" : cpuTraceFile;
+                 if (writeProfilerTrace(file))
+                     printf("CPU trace written to %s\n", file.c_str());
+                 else
+                     std::cout << "ERROR: Failed to write CPU trace " << file << std::endl;
+             }
  
-         static GLuint texBloomFinal = createColorTexture(SCR_WIDTH, SCR_HEIGHT);
-         {
-             RenderToTextureInfo rtti;
-             rtti.fragShader = "shader/bloom_composite.frag";
-             rtti.textureUniforms["texture0"] = texBlackhole;
-             rtti.textureUniforms["texture1"] = texUpsampled[0];
-             rtti.targetTexture = texBloomFinal;
-             rtti.width = SCR_WIDTH;
-             rtti.height = SCR_HEIGHT;
+             if (ImGui::Button("tuneQuality") && !qualityTuner.isRunning())
+                 qualityTuner.start(dynamicResolution.settings.targetFrameMs);
+             if (qualityTuner.isRunning()) {
+                 ImGui::SameLine();
+                 ImGui::ProgressBar(qualityTuner.progress(), ImVec2(120.0f, 0.0f));
+                 if (qualityTuner.update(gpuTimer->frameMs())) {
+                     qualityPresets = qualityTuner.presets();
+                     saveQualityPresets(QUALITY_PRESETS_FILE, qualityPresets);
+                 }
+             }
  
-             IMGUI_SLIDER(bloomStrength, 0.1f, 0.0f, 1.0f);
+             QualitySettings quality;
+             quality.bloomIterations = bloomIterationsSetting;
+             bool qualityOverride = false;
+             if (qualityTuner.isRunning()) {
+                 quality = qualityTuner.currentSettings();
+                 qualityOverride = true;
+             } else if (qualityPreset > 0 &&
+                        qualityPresets.count(qualityPresetItems[qualityPreset])) {
+                 quality = qualityPresets[qualityPresetItems[qualityPreset]];
+                 qualityOverride = true;
+             }
  
-             renderToTexture(rtti);
-         }
+             // The selected quality is the ceiling the controller scales down
+             // from; the tuner needs the knobs to stay where it put them.
+             dynamicResolution.settings.maxRenderScale = quality.renderScale;
+             dynamicResolution.settings.maxSteps = quality.steps;
+             dynamicResolution.settings.maxBloomIterations = quality.bloomIterations;
+             if (dynamicResolutionEnabled && !qualityTuner.isRunning() && !benchmarkMode) {
+                 // Frames that skipped the march say nothing about its cost,
+                 // and a paused image keeps its quality so that it stays
+                 // memoized.
+                 if (!pauseTime && gpuTimer->passTimes().count("blackhole_main"))
+                     dynamicResolution.update(gpuTimer->frameMs());
+             } else {
+                 dynamicResolution.reset();
+             }
+             const float renderScale = dynamicResolution.renderScale();
+             const int renderWidth = std::max((int)(width * renderScale), 1);
+             const int renderHeight = std::max((int)(height * renderScale), 1);
+             ImGui::Text("renderScale %.2f (%dx%d), steps %d, GPU %.2f ms", renderScale,
+                         renderWidth, renderHeight, dynamicResolution.stepCount(),
+                         gpuTimer->frameMs());
+ 
+             static GLuint galaxy = loadCubemap("assets/skybox_nebula_dark");
+             static GLuint colorMap = loadTexture2D("assets/color_map.png");
+             static GLuint uvChecker = loadTexture2D("assets/uv_checker.png");
+ 
+             // Debug view replacing the final image with the per-pixel cost of
+             // the black hole pass.
+             static bool debugCostView = false;
+             float adiskNoiseLODUsed = quality.adiskNoiseLOD;
+ 
+             GLuint texBlackhole = renderTargets.get("blackhole", renderWidth, renderHeight);
+             {
+                 RenderToTextureInfo rtti;
+                 rtti.fragShader = "shader/blackhole_main.frag";
+                 rtti.cubemapUniforms["galaxy"] = galaxy;
+                 rtti.textureUniforms["colorMap"] = colorMap;
+                 rtti.floatUniforms["maxSteps"] = (float)dynamicResolution.stepCount();
+                 rtti.targetTexture = texBlackhole;
+                 rtti.width = renderWidth;
+                 rtti.height = renderHeight;
+ 
+                 IMGUI_TOGGLE(gravatationalLensing, true);
+                 IMGUI_TOGGLE(renderBlackHole, true);
+                 IMGUI_TOGGLE(mouseControl, true);
+                 IMGUI_SLIDER(cameraRoll, 0.0f, -180.0f, 180.0f);
+                 IMGUI_TOGGLE(frontView, false);
+                 IMGUI_TOGGLE(topView, false);
+                 IMGUI_TOGGLE(adiskEnabled, true);
+                 IMGUI_TOGGLE(adiskParticle, true);
+                 // Particles integrated by the simulation replace the noise disk.
+                 static bool adiskSimulated = false;
+                 static bool adiskRelativistic = true;
+                 static float particleExposure = 1.0f;
+                 ImGui::Checkbox("adiskSimulated", &adiskSimulated);
+                 if (adiskSimulated) {
+                     ImGui::Checkbox("adiskRelativistic", &adiskRelativistic);
+                     ImGui::SliderFloat("particleExposure", &particleExposure, 0.0f, 10.0f);
+                     ImGui::Text("%d particles, %s upload", particleRenderer->particleCount(),
+                                 particleRenderer->isPersistent() ? "persistent mapped" : "glBufferSubData");
+                     if (gravatationalLensing && renderBlackHole) {
+                         lensingTable->build();
+                         if (lensingTable->isBuilding())
+                             ImGui::Text("Building the lensing table...");
+                     }
+                 }
+                 simulation.setParticles(adiskSimulated ? particleCount : 0, adiskRelativistic);
+                 const bool drawParticles = adiskSimulated && adiskEnabled && !debugCostView;
+                 if (adiskSimulated)
+                     rtti.floatUniforms["adiskEnabled"] = 0.0f;
+                 IMGUI_SLIDER(adiskDensityV, 2.0f, 0.0f, 10.0f);
+                 IMGUI_SLIDER(adiskDensityH, 4.0f, 0.0f, 10.0f);
+                 IMGUI_SLIDER(adiskHeight, 0.55f, 0.0f, 1.0f);
+                 IMGUI_SLIDER(adiskLit, 0.25f, 0.0f, 4.0f);
+                 IMGUI_SLIDER(adiskNoiseLOD, 5.0f, 1.0f, 12.0f);
+                 IMGUI_SLIDER(adiskNoiseScale, 0.8f, 0.0f, 10.0f);
+                 static float adiskSpeed = 0.5f;
+                 ImGui::SliderFloat("adiskSpeed", &adiskSpeed, 0.0f, 1.0f);
+                 simulation.setDiskSpeed(adiskSpeed);
+                 ImGui::Checkbox("debugCostView", &debugCostView);
+                 rtti.floatUniforms["debugCostView"] = debugCostView ? 1.0f : 0.0f;
+                 if (workCountersSupported)
+                     rtti.floatUniforms["countWork"] = countWork ? 1.0f : 0.0f;
+                 if (qualityOverride)
+                     rtti.floatUniforms["adiskNoiseLOD"] = quality.adiskNoiseLOD;
+                 adiskNoiseLODUsed = rtti.floatUniforms["adiskNoiseLOD"];
+                 if (benchmarkMode) {
+                     rtti.floatUniforms["mouseControl"] = cameraKey.mouseControl ? 1.0f : 0.0f;
+                     rtti.floatUniforms["frontView"] = cameraKey.frontView ? 1.0f : 0.0f;
+                     rtti.floatUniforms["topView"] = cameraKey.topView ? 1.0f : 0.0f;
+                 }
+ 
+                 // Late latch: the cursor and the camera orbit are sampled
+                 // as close to submitting the pass as possible.
+                 if (!benchmarkMode)
+                     input.latestCursor(mouseX, mouseY);
+                 const SimulationState simulationState = simulation.sample(getFrameTime());
+                 framePacer->latchInput();
+                 // The shader normalizes the cursor by the target resolution.
+                 rtti.floatUniforms["mouseX"] = mouseX * renderWidth / width;
+                 rtti.floatUniforms["mouseY"] = mouseY * renderHeight / height;
+                 rtti.floatUniforms["time"] = (float)simulationState.time;
+                 rtti.floatUniforms["cameraOrbitX"] = simulationState.cameraOrbit.x;
+                 rtti.floatUniforms["cameraOrbitY"] = simulationState.cameraOrbit.y;
+                 rtti.floatUniforms["cameraOrbitZ"] = simulationState.cameraOrbit.z;
+                 rtti.floatUniforms["adiskPhase"] = simulationState.adiskPhase;
+ 
+                 if (panorama) {
+                     panorama->update();
+                     panorama->setUniforms(rtti);
+ 
+                     // Low resolution feedback pass recording the panorama tiles
+                     // the lensed rays end up sampling.
+                     const int VT_FEEDBACK_SCALE = 8;
+                     RenderToTextureInfo feedbackRtti = rtti;
+                     feedbackRtti.width = std::max(renderWidth / VT_FEEDBACK_SCALE, 1);
+                     feedbackRtti.height = std::max(renderHeight / VT_FEEDBACK_SCALE, 1);
+                     // The shader reads the cursor relative to the target
+                     // size, so it has to shrink with it to trace the same view.
+                     feedbackRtti.floatUniforms["mouseX"] =
+                         rtti.floatUniforms["mouseX"] * feedbackRtti.width / rtti.width;
+                     feedbackRtti.floatUniforms["mouseY"] =
+                         rtti.floatUniforms["mouseY"] * feedbackRtti.height / rtti.height;
+                     GLuint texFeedback = renderTargets.get(
+                         "vtFeedback", feedbackRtti.width, feedbackRtti.height);
+                     feedbackRtti.name = "vtFeedback";
+                     feedbackRtti.targetTexture = texFeedback;
+                     feedbackRtti.floatUniforms["vtFeedback"] = 1.0f;
+                     feedbackRtti.floatUniforms["debugCostView"] = 0.0f;
+                     if (workCountersSupported)
+                         feedbackRtti.floatUniforms["countWork"] = 0.0f;
+                     feedbackRtti.floatUniforms["vtLodBias"] = -log2f((float)VT_FEEDBACK_SCALE);
+                     renderToTexture(feedbackRtti);
+                     panorama->processFeedback(texFeedback, feedbackRtti.width,
+                                               feedbackRtti.height);
+                 }
+ 
+                 // The particles are added on top of the march, so their
+                 // inputs are part of the pass.
+                 if (simulation.updateParticles())
+                     particleRenderer->upload(simulation.particles());
+                 const bool lensed = gravatationalLensing && renderBlackHole;
+                 const GLuint particleLensing = lensed ? lensingTable->texture() : 0;
+                 if (drawParticles) {
+                     const double snapshotTime = particleRenderer->uploadedTime();
+                     const int particles = particleRenderer->particleCount();
+                     rtti.externalInputs = hashBytes(&snapshotTime, sizeof(snapshotTime));
+                     rtti.externalInputs = hashBytes(&particles, sizeof(particles), rtti.externalInputs);
+                     rtti.externalInputs = hashBytes(&particleExposure, sizeof(particleExposure),
+                                                     rtti.externalInputs);
+                     rtti.externalInputs = hashBytes(&particleLensing, sizeof(particleLensing),
+                                                     rtti.externalInputs);
+                 }
+ 
+                 const bool blackholeRendered = renderToTexture(rtti);
+ 
+                 if (drawParticles && blackholeRendered) {
+                     PROFILE_ZONE("particles");
+                     gpuTimer->begin("particles");
+                     // Same total brightness whatever the particle count and
+                     // render resolution.
+                     std::map<std::string, float> particleUniforms = rtti.floatUniforms;
+                     particleUniforms["particleIntensity"] =
+                         particleExposure * particleUniforms["adiskLit"] * renderWidth *
+                         renderHeight / std::max(particleRenderer->particleCount(), 1);
+                     particleRenderer->render(texBlackhole, renderWidth, renderHeight,
+                                              simulationState.time, particleUniforms, colorMap,
+                                              particleLensing);
+                     gpuTimer->end();
+                 }
+             }
+ 
+             // The post chain runs on transient targets: each is released
+             // after its last reader, and later targets reuse its texture.
+             // The bloom chain only adds a blurred glow, so by default it
+             // runs on packed floats; the composite keeps half floats for
+             // the tonemapper.
+             IMGUI_FORMAT(bloomFormat, 1);
+             GLuint texBrightness = renderTargets.acquireTransient(
+                 renderWidth, renderHeight, TARGET_FORMATS[bloomFormat]);
+             {
+                 RenderToTextureInfo rtti;
+                 rtti.fragShader = "shader/bloom_brightness_pass.frag";
+                 rtti.textureUniforms["texture0"] = texBlackhole;
+                 rtti.targetTexture = texBrightness;
+                 rtti.width = renderWidth;
+                 rtti.height = renderHeight;
+                 renderToTexture(rtti);
+             }
  
-         static GLuint texTonemapped = createColorTexture(SCR_WIDTH, SCR_HEIGHT);
-         {
-             RenderToTextureInfo rtti;
-             rtti.fragShader = "shader/tonemapping.frag";
-             rtti.textureUniforms["texture0"] = texBloomFinal;
-             rtti.targetTexture = texTonemapped;
-             rtti.width = SCR_WIDTH;
-             rtti.height = SCR_HEIGHT;
+             GLuint texDownsampled[MAX_BLOOM_ITER];
+             GLuint texUpsampled[MAX_BLOOM_ITER];
+ 
+             ImGui::SliderInt("bloomIterations", &bloomIterationsSetting, 1, 8);
+             const int bloomIterations =
+                 std::min(std::max(dynamicResolution.bloomIterations(), 1), MAX_BLOOM_ITER);
+             for (int level = 0; level < bloomIterations; level++) {
+                 RenderToTextureInfo rtti;
+                 rtti.name = "bloom_downsample" + std::to_string(level);
+                 rtti.fragShader = "shader/bloom_downsample.frag";
+                 rtti.textureUniforms["texture0"] = (level == 0 ? texBrightness : texDownsampled[level - 1]);
+                 rtti.width = std::max(renderWidth >> (level + 1), 1);
+                 rtti.height = std::max(renderHeight >> (level + 1), 1);
+                 texDownsampled[level] = renderTargets.acquireTransient(
+                     rtti.width, rtti.height, TARGET_FORMATS[bloomFormat]);
+                 rtti.targetTexture = texDownsampled[level];
+                 if (workCountersSupported)
+                     rtti.floatUniforms["countWork"] = countWork ? 1.0f : 0.0f;
+                 renderToTexture(rtti);
+             }
  
-             IMGUI_TOGGLE(tonemappingEnabled, true);
-             IMGUI_SLIDER(gamma, 2.5f, 1.0f, 4.0f);
+             for (int level = bloomIterations - 1; level >= 0; level--) {
+                 RenderToTextureInfo rtti;
+                 rtti.name = "bloom_upsample" + std::to_string(level);
+                 rtti.fragShader = "shader/bloom_upsample.frag";
+                 rtti.textureUniforms["texture0"] = (level == bloomIterations - 1 ? texDownsampled[level] : texUpsampled[level + 1]);
+                 rtti.textureUniforms["texture1"] = (level == 0 ? texBrightness : texDownsampled[level - 1]);
+                 rtti.width = std::max(renderWidth >> level, 1);
+                 rtti.height = std::max(renderHeight >> level, 1);
+                 texUpsampled[level] = renderTargets.acquireTransient(
+                     rtti.width, rtti.height, TARGET_FORMATS[bloomFormat]);
+                 rtti.targetTexture = texUpsampled[level];
+                 if (workCountersSupported)
+                     rtti.floatUniforms["countWork"] = countWork ? 1.0f : 0.0f;
+                 renderToTexture(rtti);
+                 // Every downsampled level and the brightness are read for
+                 // the last time here.
+                 renderTargets.releaseTransient(rtti.textureUniforms["texture0"]);
+                 renderTargets.releaseTransient(rtti.textureUniforms["texture1"]);
+             }
+             workCounters->endFrame();
+ 
+             IMGUI_FORMAT(compositeFormat, 0);
+             GLuint texBloomFinal = renderTargets.acquireTransient(
+                 width, height, TARGET_FORMATS[compositeFormat]);
+             {
+                 RenderToTextureInfo rtti;
+                 rtti.fragShader = "shader/bloom_composite.frag";
+                 rtti.textureUniforms["texture0"] = texBlackhole;
+                 rtti.textureUniforms["texture1"] = texUpsampled[0];
+                 rtti.targetTexture = texBloomFinal;
+                 rtti.width = width;
+                 rtti.height = height;
+ 
+                 IMGUI_SLIDER(bloomStrength, 0.1f, 0.0f, 1.0f);
+ 
+                 renderToTexture(rtti);
+                 renderTargets.releaseTransient(texUpsampled[0]);
+             }
  
-             renderToTexture(rtti);
+             // The tonemapper writes gamma encoded display values.
+             IMGUI_FORMAT(tonemapFormat, 2);
+             GLuint texTonemapped = renderTargets.acquireTransient(
+                 width, height, TARGET_FORMATS[tonemapFormat]);
+             {
+                 RenderToTextureInfo rtti;
+                 rtti.fragShader = "shader/tonemapping.frag";
+                 rtti.textureUniforms["texture0"] = texBloomFinal;
+                 rtti.targetTexture = texTonemapped;
+                 rtti.width = width;
+                 rtti.height = height;
+ 
+                 IMGUI_TOGGLE(tonemappingEnabled, true);
+                 IMGUI_SLIDER(gamma, 2.5f, 1.0f, 4.0f);
+ 
+                 renderToTexture(rtti);
+                 renderTargets.releaseTransient(texBloomFinal);
+             }
+ 
+             GLuint texFinal = texTonemapped;
+             if (debugCostView) {
+                 costReduction->reduce(texBlackhole, renderHeight);
+ 
+                 static int costChannel = 0;
+                 static float costScale = 1.0f;
+                 const char *costChannelItems[] = {"steps", "adiskColor calls", "noise octaves"};
+                 ImGui::Combo("costChannel", &costChannel, costChannelItems,
+                              IM_ARRAYSIZE(costChannelItems));
+                 ImGui::SliderFloat("costScale", &costScale, 0.01f, 1.0f, "%.2f",
+                                    ImGuiSliderFlags_Logarithmic);
+                 const glm::dvec3 &cost = costReduction->totals();
+                 const double pixels = (double)renderWidth * renderHeight;
+                 ImGui::Text("Per frame: %.2fM steps, %.2fM adiskColor, %.2fM octaves",
+                             cost.x / 1.0e6, cost.y / 1.0e6, cost.z / 1.0e6);
+                 ImGui::Text("Per pixel: %.1f steps, %.1f adiskColor, %.1f octaves",
+                             cost.x / pixels, cost.y / pixels, cost.z / pixels);
+ 
+                 renderTargets.releaseTransient(texTonemapped);
+                 texFinal = renderTargets.acquireTransient(width, height, GL_RGBA8);
+                 RenderToTextureInfo rtti;
+                 rtti.fragShader = "shader/cost_heatmap.frag";
+                 rtti.textureUniforms["texture0"] = texBlackhole;
+                 rtti.floatUniforms["costChannel"] = (float)costChannel;
+                 // Steps and disk calls are bounded by the step count, octaves
+                 // by steps times the noise LOD; costScale zooms into the range.
+                 const float maxSteps = (float)dynamicResolution.stepCount();
+                 rtti.floatUniforms["costMax"] =
+                     costScale * (costChannel == 2 ? maxSteps * adiskNoiseLODUsed : maxSteps);
+                 rtti.targetTexture = texFinal;
+                 rtti.width = width;
+                 rtti.height = height;
+                 renderToTexture(rtti);
+             }
+ 
+             // Headless contexts have no default framebuffer, so the final
+             // image and the UI go to an offscreen target.
+             GLuint presentFramebuffer = 0;
+             if (headless)
+                 presentFramebuffer = getTextureFramebuffer(
+                     renderTargets.get("present", width, height, GL_RGBA8));
+             {
+                 PROFILE_ZONE("passthrough");
+                 gpuTimer->begin("passthrough");
+                 passthrough.render(texFinal, width, height, presentFramebuffer);
+                 gpuTimer->end();
+             }
+             renderTargets.endTransientFrame();
+ 
+             // Render the stats overlay
+             {
+                 PROFILE_ZONE("overlay");
+                 RenderStatsOverlay(gpuTimer.get(), countGpuWork ? workCounters.get() : nullptr);
+             }
+ 
+             {
+                 PROFILE_ZONE("imguiRender");
+                 ImGui::Render();
+                 ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+             }
+             framePacer->endRendering();
+ 
+             {
+                 PROFILE_ZONE("swap");
+                 if (headless)
+                     glFlush();
+                 else
+                     glfwSwapBuffers(window);
+             }
+             framePacer->endFrame();
+             frameCount++;
+ 
+             advanceFrameClock();
+             samplePerfCounters();
+             const GlCallStats glStats = endGlStatsFrame();
+             const double cpuFrameMs = std::chrono::duration<double, std::milli>(
+                 std::chrono::steady_clock::now() - frameStart).count();
+             // The GPU time lags a few frames behind, see GpuTimer.
+             RecordFrameTimes((float)cpuFrameMs, (float)gpuTimer->frameMs());
+             if (benchmarkMode) {
+                 benchmarkRecorder.recordCpuCounters(perfCounterSnapshot());
+                 if (glCallStatsEnabled()) {
+                     std::map<std::string, double> glCalls;
+                     for (auto const &[name, count] : glCallStatsFields(glStats))
+                         glCalls[name] = count;
+                     benchmarkRecorder.recordCounters("glCalls", glCalls);
+                 }
+                 if (benchmarkEnergy.isOpen())
+                     benchmarkRecorder.recordEnergy(benchmarkEnergy.joules());
+                 benchmarkRecorder.recordCounters("pacing", {{"inputLatencyMs", framePacer->latencyMs()}});
+                 const auto &transient = renderTargets.transientStats();
+                 benchmarkRecorder.recordCounters("renderTargets", {
+                     {"postAllocatedBytes", (double)transient.allocatedBytes},
+                     {"postUnaliasedBytes", (double)transient.unaliasedBytes},
+                     {"totalBytes", (double)renderTargets.memoryUsage()},
+                 });
+                 benchmarkRecorder.recordCpuFrame(cpuFrameMs);
+             }
+ 
+             // Nothing changed: sleep until input arrives rather than draw
+             // the same frame again. Background work (streamed panorama
+             // tiles, the lensing table) is picked up on the timeout.
+             const uint64_t previousFrameHash = memoStats.frameHash;
+             memoStats = takePassMemoStats();
+             const bool unchanged = memoStats.frameHash != 0 && memoStats.frameHash == previousFrameHash;
+             quietFrames = unchanged && eventCount == 0 ? quietFrames + 1 : 0;
+             if (renderThreaded && !benchmarkMode && quietFrames >= IDLE_FRAMES) {
+                 PROFILE_ZONE("idle");
+                 input.waitForEvents(IDLE_TIMEOUT);
+             }
          }
+     };
+ 
+     if (renderThreaded) {
+         glfwMakeContextCurrent(NULL);
+         std::atomic<bool> renderLoopDone(false);
+         std::thread renderThread([&]() {
+             setProfilerThreadName("render");
+             if (perfCountersEnabled())
+                 registerPerfCounterThread("render");
+             glfwMakeContextCurrent(window);
+             renderLoop();
+             glfwMakeContextCurrent(NULL);
+             renderLoopDone = true;
+             glfwPostEmptyEvent();
+         });
+         // Events only; a slow frame no longer holds them up.
+         while (!renderLoopDone)
+             glfwWaitEvents();
+         renderThread.join();
+         glfwMakeContextCurrent(window);
+     } else {
+         renderLoop();
+     }
+     if (input.droppedEvents() > 0)
+         std::cout << "WARNING: " << input.droppedEvents()
+                   << " input events were dropped, the render thread fell behind" << std::endl;
  
-         passthrough.render(texTonemapped);
+     simulation.stop();
  
-         // Render the stats overlay
-         RenderStatsOverlay();
+     if (benchmarkMode) {
+         gpuTimer->finish();
+         workCounters->finish();
+         if (benchmarkRecorder.writeJson(benchmarkOutput))
+             printf("Benchmark results written to %s\n", benchmarkOutput.c_str());
+     }
  
-         ImGui::Render();
-         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+     if (headless) {
+         glFinish();
+         const double elapsed = glfwGetTime() - startTime;
+         printf("Rendered %d frames at %dx%d in %.2f s (%.2f ms/frame) on %s\n",
+                frameCount, windowWidth, windowHeight, elapsed,
+                frameCount ? elapsed * 1000.0 / frameCount : 0.0,
+                (const char *)glGetString(GL_RENDERER));
+     }
  
-         glfwSwapBuffers(window);
+     if (isProfilerCapturing() && !cpuTraceFile.empty()) {
+         if (writeProfilerTrace(cpuTraceFile))
+             printf("CPU trace written to %s\n", cpuTraceFile.c_str());
+         else
+             std::cout << "ERROR: Failed to write CPU trace " << cpuTraceFile << std::endl;
      }
  
-     simulationRunning = false;
-     simulationThread.join();
+     // Everything owning GL objects has to go while the context is current.
+     panorama.reset();
+     particleRenderer.reset();
+     lensingTable.reset();
+     framePacer.reset();
+     setRenderToTextureTimer(nullptr);
+     gpuTimer.reset();
+     workCounters.reset();
+     costReduction.reset();
+     renderTargets.releaseAll();
  
      glfwDestroyWindow(window);
      glfwTerminate();
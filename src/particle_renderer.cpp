@@ -0,0 +1,225 @@
+#include <particle_renderer.h>
+
+#include <disk_particles.h>
+#include <gl_stats.h>
+#include <job_system.h>
+#include <lensing_table.h>
+#include <profiler.h>
+#include <render.h>
+#include <shader.h>
+
+#include <cstring>
+#include <iostream>
+
+static const int UPLOAD_GRAIN_SIZE = 65536;
+
+ParticleRenderer::ParticleRenderer() {
+  program = createShaderProgram("shader/particles.vert", "shader/particles.frag");
+  glUseProgram(program);
+  glUniform1i(glGetUniformLocation(program, "colorMap"), 0);
+  glUniform1i(glGetUniformLocation(program, "lensingTable"), 1);
+  glUniform1f(glGetUniformLocation(program, "minRadius"),
+              LensingTable::MIN_RADIUS);
+  glUniform1f(glGetUniformLocation(program, "maxRadius"),
+              LensingTable::MAX_RADIUS);
+  glUniform1f(glGetUniformLocation(program, "minCameraDistance"),
+              LensingTable::MIN_CAMERA_DISTANCE);
+  glUniform1f(glGetUniformLocation(program, "maxCameraDistance"),
+              LensingTable::MAX_CAMERA_DISTANCE);
+  glUseProgram(0);
+
+  glGenVertexArrays(1, &vao);
+  persistent = GLEW_ARB_buffer_storage;
+}
+
+ParticleRenderer::~ParticleRenderer() {
+  for (GLsync &fence : fences) {
+    if (fence) {
+      glDeleteSync(fence);
+    }
+  }
+  if (mapped) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+  if (buffer) {
+    glDeleteBuffers(1, &buffer);
+  }
+  glDeleteVertexArrays(1, &vao);
+  glDeleteProgram(program);
+}
+
+void ParticleRenderer::allocate(int newCapacity) {
+  for (GLsync &fence : fences) {
+    if (fence) {
+      glDeleteSync(fence);
+      fence = 0;
+    }
+  }
+  if (mapped) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    mapped = nullptr;
+  }
+  if (buffer) {
+    glDeleteBuffers(1, &buffer);
+  }
+
+  capacity = newCapacity;
+  region = 0;
+  const GLsizeiptr regionSize = (GLsizeiptr)capacity * ATTRIBUTES * sizeof(float);
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  if (persistent) {
+    const GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage(GL_ARRAY_BUFFER, regionSize * REGIONS, NULL, flags);
+    mapped = (char *)glMapBufferRange(GL_ARRAY_BUFFER, 0, regionSize * REGIONS,
+                                      flags);
+    if (!mapped) {
+      std::cout << "ERROR: Failed to map the particle buffer, falling back to "
+                   "glBufferSubData"
+                << std::endl;
+      persistent = false;
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+      allocate(newCapacity);
+      return;
+    }
+  } else {
+    glBufferData(GL_ARRAY_BUFFER, regionSize, NULL, GL_STREAM_DRAW);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+bool ParticleRenderer::waitForRegion(int index) {
+  if (!fences[index]) {
+    return true;
+  }
+  GLenum status;
+  do {
+    status = glClientWaitSync(fences[index], GL_SYNC_FLUSH_COMMANDS_BIT,
+                              100000000);
+  } while (status == GL_TIMEOUT_EXPIRED);
+  if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+    return false;
+  }
+  glDeleteSync(fences[index]);
+  fences[index] = 0;
+  return true;
+}
+
+void ParticleRenderer::upload(const ParticleSnapshot &snapshot) {
+  PROFILE_ZONE("uploadParticles");
+  const int size = snapshot.size();
+  if (size > capacity) {
+    allocate(size);
+  }
+  count = 0;
+  snapshotTime = snapshot.time;
+  if (size == 0) {
+    return;
+  }
+
+  const float *sources[ATTRIBUTES] = {snapshot.x.data(),  snapshot.y.data(),
+                                      snapshot.z.data(),  snapshot.vx.data(),
+                                      snapshot.vy.data(), snapshot.vz.data()};
+  if (persistent) {
+    const int next = (region + 1) % REGIONS;
+    if (!waitForRegion(next)) {
+      std::cout << "ERROR: Waiting for the particle buffer failed" << std::endl;
+      return;
+    }
+    region = next;
+    float *destination =
+        (float *)mapped + (size_t)region * capacity * ATTRIBUTES;
+    jobSystem().parallelFor(size, UPLOAD_GRAIN_SIZE, [&](int begin, int end) {
+      for (int i = 0; i < ATTRIBUTES; i++) {
+        memcpy(destination + (size_t)i * capacity + begin, sources[i] + begin,
+               (end - begin) * sizeof(float));
+      }
+    });
+  } else {
+    // Orphan the storage so the driver does not wait for the previous draw.
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER,
+                 (GLsizeiptr)capacity * ATTRIBUTES * sizeof(float), NULL,
+                 GL_STREAM_DRAW);
+    for (int i = 0; i < ATTRIBUTES; i++) {
+      glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)i * capacity * sizeof(float),
+                      size * sizeof(float), sources[i]);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+  count = size;
+}
+
+GLint ParticleRenderer::uniformLocation(const std::string &name) {
+  auto it = uniformLocations.find(name);
+  if (it == uniformLocations.end()) {
+    it = uniformLocations
+             .emplace(name, glGetUniformLocation(program, name.c_str()))
+             .first;
+  }
+  return it->second;
+}
+
+void ParticleRenderer::render(GLuint targetTexture, int width, int height,
+                              double time,
+                              const std::map<std::string, float> &floatUniforms,
+                              GLuint colorMap, GLuint lensingTable) {
+  if (count == 0) {
+    return;
+  }
+
+  GLint previousVao = 0;
+  glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVao);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, getTextureFramebuffer(targetTexture));
+  glViewport(0, 0, width, height);
+  glDisable(GL_DEPTH_TEST);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_ONE, GL_ONE);
+
+  glUseProgram(program);
+  glUniform2f(uniformLocation("resolution"), (float)width, (float)height);
+  glUniform1f(uniformLocation("particleDt"), (float)(time - snapshotTime));
+  for (auto const &[name, val] : floatUniforms) {
+    GLint loc = uniformLocation(name);
+    if (loc != -1) {
+      glUniform1f(loc, val);
+    }
+  }
+  glUniform1f(uniformLocation("lensed"), lensingTable ? 1.0f : 0.0f);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, colorMap);
+  if (lensingTable) {
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_3D, lensingTable);
+    glActiveTexture(GL_TEXTURE0);
+  }
+
+  glBindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  const size_t base = persistent ? (size_t)region * capacity * ATTRIBUTES : 0;
+  for (int i = 0; i < ATTRIBUTES; i++) {
+    glEnableVertexAttribArray(i);
+    glVertexAttribPointer(
+        i, 1, GL_FLOAT, GL_FALSE, 0,
+        (void *)((base + (size_t)i * capacity) * sizeof(float)));
+  }
+  // Instance 0 is the primary image, instance 1 the secondary one.
+  glDrawArraysInstanced(GL_POINTS, 0, count, lensingTable ? 2 : 1);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  if (persistent) {
+    if (fences[region]) {
+      glDeleteSync(fences[region]);
+    }
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+
+  glBindVertexArray(previousVao);
+  glUseProgram(0);
+  glDisable(GL_BLEND);
+}
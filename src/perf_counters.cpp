@@ -0,0 +1,154 @@
+#include <perf_counters.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+PerfCounterValues &PerfCounterValues::operator+=(const PerfCounterValues &other) {
+  cycles += other.cycles;
+  instructions += other.instructions;
+  cacheReferences += other.cacheReferences;
+  cacheMisses += other.cacheMisses;
+  branches += other.branches;
+  branchMisses += other.branchMisses;
+  return *this;
+}
+
+static const int COUNTER_COUNT = 6;
+
+struct PerfThread {
+  std::string name;
+  int fds[COUNTER_COUNT];
+  uint64_t last[COUNTER_COUNT];
+  PerfCounterValues frame;
+};
+
+static bool enabled = false;
+static std::mutex perfMutex;
+static std::vector<PerfThread> perfThreads;
+
+#ifdef __linux__
+static const uint64_t COUNTER_CONFIGS[COUNTER_COUNT] = {
+    PERF_COUNT_HW_CPU_CYCLES,       PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES};
+
+// Counts user space of the calling thread on any CPU.
+static int openCounter(uint64_t config) {
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static bool openCounters(int fds[COUNTER_COUNT]) {
+  for (int i = 0; i < COUNTER_COUNT; i++) {
+    fds[i] = openCounter(COUNTER_CONFIGS[i]);
+    if (fds[i] < 0) {
+      for (int j = 0; j < i; j++) {
+        close(fds[j]);
+      }
+      return false;
+    }
+  }
+  return true;
+}
+
+// Running total, scaled up when the kernel multiplexed the counter because
+// more events were open than the PMU has registers.
+static uint64_t readCounter(int fd) {
+  uint64_t values[3] = {0, 0, 0}; // value, time enabled, time running
+  if (read(fd, values, sizeof(values)) != sizeof(values) || values[2] == 0) {
+    return 0;
+  }
+  return (uint64_t)((double)values[0] * values[1] / values[2]);
+}
+#endif
+
+bool enablePerfCounters() {
+#ifdef __linux__
+  int fds[COUNTER_COUNT];
+  if (!openCounters(fds)) {
+    std::cout << "ERROR: perf_event_open failed: " << strerror(errno)
+              << " (hardware counters unavailable or restricted by "
+                 "/proc/sys/kernel/perf_event_paranoid)"
+              << std::endl;
+    return false;
+  }
+  for (int fd : fds) {
+    close(fd);
+  }
+  enabled = true;
+  return true;
+#else
+  std::cout << "ERROR: Hardware performance counters need Linux" << std::endl;
+  return false;
+#endif
+}
+
+bool perfCountersEnabled() { return enabled; }
+
+void registerPerfCounterThread(const std::string &name) {
+#ifdef __linux__
+  if (!enabled) {
+    return;
+  }
+  PerfThread thread;
+  thread.name = name;
+  if (!openCounters(thread.fds)) {
+    std::cout << "ERROR: perf_event_open failed for thread " << name << ": "
+              << strerror(errno) << std::endl;
+    return;
+  }
+  for (int i = 0; i < COUNTER_COUNT; i++) {
+    thread.last[i] = readCounter(thread.fds[i]);
+  }
+  std::lock_guard<std::mutex> lock(perfMutex);
+  perfThreads.push_back(thread);
+#else
+  (void)name;
+#endif
+}
+
+void samplePerfCounters() {
+#ifdef __linux__
+  std::lock_guard<std::mutex> lock(perfMutex);
+  for (PerfThread &thread : perfThreads) {
+    uint64_t delta[COUNTER_COUNT];
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+      const uint64_t value = readCounter(thread.fds[i]);
+      delta[i] = value > thread.last[i] ? value - thread.last[i] : 0;
+      thread.last[i] = value;
+    }
+    thread.frame.cycles = delta[0];
+    thread.frame.instructions = delta[1];
+    thread.frame.cacheReferences = delta[2];
+    thread.frame.cacheMisses = delta[3];
+    thread.frame.branches = delta[4];
+    thread.frame.branchMisses = delta[5];
+  }
+#endif
+}
+
+std::vector<ThreadPerfCounters> perfCounterSnapshot() {
+  std::lock_guard<std::mutex> lock(perfMutex);
+  std::vector<ThreadPerfCounters> snapshot;
+  for (const PerfThread &thread : perfThreads) {
+    snapshot.push_back({thread.name, thread.frame});
+  }
+  return snapshot;
+}
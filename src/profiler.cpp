@@ -0,0 +1,173 @@
+#include <profiler.h>
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+std::atomic<bool> profilerEnabled{false};
+
+struct ZoneEvent {
+  const char *name;
+  uint64_t start;
+  uint64_t end;
+};
+
+// Written only by its owning thread. The exporter reads the first `count`
+// events, which the release store on `count` makes visible.
+struct ThreadBuffer {
+  static const uint32_t CAPACITY = 1 << 16;
+
+  std::unique_ptr<ZoneEvent[]> events{new ZoneEvent[CAPACITY]};
+  std::atomic<uint32_t> count{0};
+  std::atomic<uint64_t> generation{0};
+  int threadId = 0;
+  std::string threadName; // Guarded by registryMutex.
+};
+
+static const auto epoch = std::chrono::steady_clock::now();
+
+// Only taken when a thread records its first zone, names a thread, interns a
+// new dynamic name, or on export.
+static std::mutex registryMutex;
+static std::vector<std::unique_ptr<ThreadBuffer>> threadBuffers;
+static std::unordered_set<std::string> internedNames;
+
+static std::atomic<uint64_t> captureGeneration{0};
+
+static thread_local ThreadBuffer *localBuffer = nullptr;
+
+static ThreadBuffer *getThreadBuffer() {
+  if (!localBuffer) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    threadBuffers.push_back(std::make_unique<ThreadBuffer>());
+    localBuffer = threadBuffers.back().get();
+    localBuffer->threadId = (int)threadBuffers.size();
+  }
+  return localBuffer;
+}
+
+static const char *internName(const std::string &name) {
+  thread_local std::unordered_map<std::string, const char *> cache;
+  auto it = cache.find(name);
+  if (it != cache.end()) {
+    return it->second;
+  }
+  std::lock_guard<std::mutex> lock(registryMutex);
+  // Elements of an unordered_set keep their address across rehashes.
+  const char *interned = internedNames.insert(name).first->c_str();
+  cache[name] = interned;
+  return interned;
+}
+
+static void writeJsonString(FILE *out, const std::string &s) {
+  fputc('"', out);
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      fputc('\\', out);
+    }
+    fputc(c, out);
+  }
+  fputc('"', out);
+}
+
+uint64_t profilerTimestampNs() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - epoch)
+      .count();
+}
+
+ProfileZone::ProfileZone(const std::string &name) {
+  if (profilerEnabled.load(std::memory_order_relaxed)) {
+    this->name = internName(name);
+    start = profilerTimestampNs();
+  }
+}
+
+void ProfileZone::record() {
+  const uint64_t end = profilerTimestampNs();
+  if (!profilerEnabled.load(std::memory_order_relaxed)) {
+    return;
+  }
+  ThreadBuffer *buffer = getThreadBuffer();
+
+  // Lazily drop the events of a previous capture.
+  const uint64_t generation = captureGeneration.load(std::memory_order_acquire);
+  if (buffer->generation.load(std::memory_order_relaxed) != generation) {
+    buffer->count.store(0, std::memory_order_relaxed);
+    buffer->generation.store(generation, std::memory_order_release);
+  }
+
+  const uint32_t index = buffer->count.load(std::memory_order_relaxed);
+  if (index >= ThreadBuffer::CAPACITY) {
+    return;
+  }
+  buffer->events[index] = {name, start, end};
+  buffer->count.store(index + 1, std::memory_order_release);
+}
+
+void startProfilerCapture() {
+  captureGeneration.fetch_add(1, std::memory_order_acq_rel);
+  profilerEnabled.store(true, std::memory_order_relaxed);
+}
+
+bool isProfilerCapturing() {
+  return profilerEnabled.load(std::memory_order_relaxed);
+}
+
+void setProfilerThreadName(const char *name) {
+  ThreadBuffer *buffer = getThreadBuffer();
+  std::lock_guard<std::mutex> lock(registryMutex);
+  buffer->threadName = name;
+}
+
+bool writeProfilerTrace(const std::string &file) {
+  profilerEnabled.store(false, std::memory_order_relaxed);
+
+  FILE *out = fopen(file.c_str(), "w");
+  if (!out) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(registryMutex);
+  const uint64_t generation = captureGeneration.load(std::memory_order_acquire);
+  bool first = true;
+  auto separator = [&]() {
+    fputs(first ? "\n" : ",\n", out);
+    first = false;
+  };
+
+  fputs("{\"traceEvents\": [", out);
+  for (const auto &buffer : threadBuffers) {
+    if (!buffer->threadName.empty()) {
+      separator();
+      fprintf(out,
+              "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+              "\"tid\": %d, \"args\": {\"name\": ",
+              buffer->threadId);
+      writeJsonString(out, buffer->threadName);
+      fputs("}}", out);
+    }
+
+    if (buffer->generation.load(std::memory_order_acquire) != generation) {
+      continue;
+    }
+    const uint32_t count = buffer->count.load(std::memory_order_acquire);
+    for (uint32_t i = 0; i < count; i++) {
+      const ZoneEvent &event = buffer->events[i];
+      separator();
+      fputs("{\"name\": ", out);
+      writeJsonString(out, event.name);
+      fprintf(out,
+              ", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, "
+              "\"dur\": %.3f}",
+              buffer->threadId, event.start / 1000.0,
+              (event.end - event.start) / 1000.0);
+    }
+  }
+  fputs("\n]}\n", out);
+  return fclose(out) == 0;
+}
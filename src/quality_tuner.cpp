@@ -0,0 +1,231 @@
+#include <quality_tuner.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+const char *const QUALITY_PRESET_NAMES[4] = {"low", "medium", "high", "ultra"};
+
+// Candidate values per knob, cheapest first. The last value of each list is
+// the reference every other measurement is taken against.
+static const float SCALE_LEVELS[] = {0.5f, 0.75f, 1.0f};
+static const int STEP_LEVELS[] = {150, 225, 300};
+static const float NOISE_LOD_LEVELS[] = {2.0f, 4.0f, 6.0f, 8.0f};
+static const int BLOOM_LEVELS[] = {4, 6, 8};
+
+static const int NUM_SCALES = sizeof(SCALE_LEVELS) / sizeof(SCALE_LEVELS[0]);
+static const int NUM_STEPS = sizeof(STEP_LEVELS) / sizeof(STEP_LEVELS[0]);
+static const int NUM_NOISE_LODS =
+    sizeof(NOISE_LOD_LEVELS) / sizeof(NOISE_LOD_LEVELS[0]);
+static const int NUM_BLOOMS = sizeof(BLOOM_LEVELS) / sizeof(BLOOM_LEVELS[0]);
+
+// Share of the frame-time target each preset may use.
+static const float PRESET_BUDGETS[4] = {0.4f, 0.6f, 0.8f, 1.0f};
+
+static QualitySettings referenceSettings() {
+  QualitySettings settings;
+  settings.renderScale = SCALE_LEVELS[NUM_SCALES - 1];
+  settings.steps = STEP_LEVELS[NUM_STEPS - 1];
+  settings.adiskNoiseLOD = NOISE_LOD_LEVELS[NUM_NOISE_LODS - 1];
+  settings.bloomIterations = BLOOM_LEVELS[NUM_BLOOMS - 1];
+  return settings;
+}
+
+void QualityTuner::start(float targetFrameMs) {
+  targetMs = targetFrameMs;
+  candidates.clear();
+  candidateMs.clear();
+  samples.clear();
+  result.clear();
+
+  // Reference first, then one knob at a time.
+  const QualitySettings reference = referenceSettings();
+  candidates.push_back(reference);
+  for (int i = 0; i < NUM_SCALES - 1; i++) {
+    QualitySettings settings = reference;
+    settings.renderScale = SCALE_LEVELS[i];
+    candidates.push_back(settings);
+  }
+  for (int i = 0; i < NUM_STEPS - 1; i++) {
+    QualitySettings settings = reference;
+    settings.steps = STEP_LEVELS[i];
+    candidates.push_back(settings);
+  }
+  for (int i = 0; i < NUM_NOISE_LODS - 1; i++) {
+    QualitySettings settings = reference;
+    settings.adiskNoiseLOD = NOISE_LOD_LEVELS[i];
+    candidates.push_back(settings);
+  }
+  for (int i = 0; i < NUM_BLOOMS - 1; i++) {
+    QualitySettings settings = reference;
+    settings.bloomIterations = BLOOM_LEVELS[i];
+    candidates.push_back(settings);
+  }
+
+  candidateIndex = 0;
+  frameInCandidate = 0;
+  running = true;
+}
+
+const QualitySettings &QualityTuner::currentSettings() const {
+  return candidates[std::min(candidateIndex, (int)candidates.size() - 1)];
+}
+
+float QualityTuner::progress() const {
+  if (candidates.empty()) {
+    return 0.0f;
+  }
+  return (candidateIndex + frameInCandidate /
+                               (float)(WARMUP_FRAMES + MEASURE_FRAMES)) /
+         candidates.size();
+}
+
+bool QualityTuner::update(double gpuFrameMs) {
+  if (!running) {
+    return false;
+  }
+
+  if (frameInCandidate >= WARMUP_FRAMES && gpuFrameMs > 0.0) {
+    samples.push_back(gpuFrameMs);
+  }
+  if (++frameInCandidate < WARMUP_FRAMES + MEASURE_FRAMES) {
+    return false;
+  }
+
+  // Median of the measured frames is robust against the odd hitch.
+  double ms = 0.0;
+  if (!samples.empty()) {
+    std::sort(samples.begin(), samples.end());
+    ms = samples[samples.size() / 2];
+  }
+  candidateMs.push_back(ms);
+  samples.clear();
+  frameInCandidate = 0;
+
+  if (++candidateIndex < (int)candidates.size()) {
+    return false;
+  }
+
+  running = false;
+  buildPresets();
+  return true;
+}
+
+void QualityTuner::buildPresets() {
+  const double referenceMs = std::max(candidateMs[0], 1e-3);
+
+  // Relative cost of each knob value, measured against the reference.
+  int index = 1;
+  std::vector<double> scaleCost(NUM_SCALES, 1.0), stepCost(NUM_STEPS, 1.0),
+      noiseCost(NUM_NOISE_LODS, 1.0), bloomCost(NUM_BLOOMS, 1.0);
+  for (int i = 0; i < NUM_SCALES - 1; i++)
+    scaleCost[i] = candidateMs[index++] / referenceMs;
+  for (int i = 0; i < NUM_STEPS - 1; i++)
+    stepCost[i] = candidateMs[index++] / referenceMs;
+  for (int i = 0; i < NUM_NOISE_LODS - 1; i++)
+    noiseCost[i] = candidateMs[index++] / referenceMs;
+  for (int i = 0; i < NUM_BLOOMS - 1; i++)
+    bloomCost[i] = candidateMs[index++] / referenceMs;
+
+  for (int p = 0; p < 4; p++) {
+    const double budget = targetMs * PRESET_BUDGETS[p];
+    double bestScore = -1.0;
+    double cheapestMs = 1e30;
+    QualitySettings best, cheapest;
+
+    for (int a = 0; a < NUM_SCALES; a++) {
+      for (int b = 0; b < NUM_STEPS; b++) {
+        for (int c = 0; c < NUM_NOISE_LODS; c++) {
+          for (int d = 0; d < NUM_BLOOMS; d++) {
+            QualitySettings settings;
+            settings.renderScale = SCALE_LEVELS[a];
+            settings.steps = STEP_LEVELS[b];
+            settings.adiskNoiseLOD = NOISE_LOD_LEVELS[c];
+            settings.bloomIterations = BLOOM_LEVELS[d];
+
+            const double predictedMs = referenceMs * scaleCost[a] *
+                                       stepCost[b] * noiseCost[c] *
+                                       bloomCost[d];
+            // Resolution matters most visually, bloom depth the least.
+            const double score = 0.4 * a / (NUM_SCALES - 1) +
+                                 0.2 * b / (NUM_STEPS - 1) +
+                                 0.25 * c / (NUM_NOISE_LODS - 1) +
+                                 0.15 * d / (NUM_BLOOMS - 1);
+
+            if (predictedMs <= budget && score > bestScore) {
+              bestScore = score;
+              best = settings;
+            }
+            if (predictedMs < cheapestMs) {
+              cheapestMs = predictedMs;
+              cheapest = settings;
+            }
+          }
+        }
+      }
+    }
+
+    // Nothing fits on this machine: fall back to the cheapest combination.
+    result[QUALITY_PRESET_NAMES[p]] = bestScore >= 0.0 ? best : cheapest;
+  }
+}
+
+bool loadQualityPresets(const std::string &file,
+                        std::map<std::string, QualitySettings> &presets) {
+  std::ifstream ifs(file, std::ios::in);
+  if (!ifs.is_open()) {
+    return false;
+  }
+
+  std::string line, section;
+  while (std::getline(ifs, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    if (line[0] == '[') {
+      section = line.substr(1, line.find(']') - 1);
+      presets[section] = QualitySettings();
+      continue;
+    }
+    const size_t eq = line.find('=');
+    if (section.empty() || eq == std::string::npos) {
+      continue;
+    }
+    const std::string key = line.substr(0, eq);
+    std::istringstream value(line.substr(eq + 1));
+    QualitySettings &settings = presets[section];
+    if (key == "renderScale")
+      value >> settings.renderScale;
+    else if (key == "steps")
+      value >> settings.steps;
+    else if (key == "adiskNoiseLOD")
+      value >> settings.adiskNoiseLOD;
+    else if (key == "bloomIterations")
+      value >> settings.bloomIterations;
+  }
+  return true;
+}
+
+bool saveQualityPresets(const std::string &file,
+                        const std::map<std::string, QualitySettings> &presets) {
+  std::ofstream ofs(file, std::ios::out);
+  if (!ofs.is_open()) {
+    std::cout << "ERROR: Failed to open file: " << file << std::endl;
+    return false;
+  }
+
+  ofs << "# Generated by the quality tuner for this machine.\n";
+  for (const char *name : QUALITY_PRESET_NAMES) {
+    auto it = presets.find(name);
+    if (it == presets.end()) {
+      continue;
+    }
+    ofs << "[" << name << "]\n"
+        << "renderScale=" << it->second.renderScale << "\n"
+        << "steps=" << it->second.steps << "\n"
+        << "adiskNoiseLOD=" << it->second.adiskNoiseLOD << "\n"
+        << "bloomIterations=" << it->second.bloomIterations << "\n";
+  }
+  return true;
+}
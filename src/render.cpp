@@ -1,18 +1,22 @@
+#include <frame_clock.h>
+#include <gl_stats.h>
+#include <gpu_timer.h>
+#include <profiler.h>
 #include <render.h>
 #include <shader.h>
 
 #include <iostream>
 
-#include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 
-GLuint createColorTexture(int width, int height, bool hdr) {
+GLuint createColorTexture(int width, int height, GLenum format) {
   GLuint colorTexture;
   glGenTextures(1, &colorTexture);
 
+  // No data is uploaded, so the pixel transfer format is only a formality.
   glBindTexture(GL_TEXTURE_2D, colorTexture);
-  glTexImage2D(GL_TEXTURE_2D, 0, hdr ? GL_RGB16F : GL_RGB, width, height, 0,
-               GL_RGB, hdr ? GL_FLOAT : GL_UNSIGNED_BYTE, NULL);
+  glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, GL_RGB,
+               GL_UNSIGNED_BYTE, NULL);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -111,30 +115,152 @@ static bool bindToTextureUnit(GLuint program, const std::string &name,
   }
 }
 
-void renderToTexture(const RenderToTextureInfo &rtti) {
+static GpuTimer *passTimer = nullptr;
+
+void setRenderToTextureTimer(GpuTimer *timer) { passTimer = timer; }
+
+static std::string passName(const RenderToTextureInfo &rtti) {
+  if (!rtti.name.empty()) {
+    return rtti.name;
+  }
+  std::string name = rtti.fragShader.substr(rtti.fragShader.rfind('/') + 1);
+  return name.substr(0, name.rfind('.'));
+}
+
+// Framebuffers lazily created by renderToTexture(), keyed by color texture.
+static std::map<GLuint, GLuint> textureFramebufferMap;
+
+static bool memoization = true;
+// Input hash of the pass that produced each render target's content.
+static std::map<GLuint, uint64_t> textureContent;
+static uint64_t modificationCount = 0;
+static PassMemoStats memoStats;
+
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed) {
+  const unsigned char *bytes = (const unsigned char *)data;
+  for (size_t i = 0; i < size; i++) {
+    seed = (seed ^ bytes[i]) * 1099511628211ull;
+  }
+  return seed;
+}
+
+static uint64_t hashString(const std::string &s, uint64_t seed) {
+  return hashBytes(s.data(), s.size() + 1, seed);
+}
+
+void setPassMemoization(bool enabled) {
+  if (!enabled) {
+    textureContent.clear();
+  }
+  memoization = enabled;
+}
+
+void markTextureModified(GLuint texture) {
+  if (memoization) {
+    modificationCount++;
+    textureContent[texture] =
+        hashBytes(&modificationCount, sizeof(modificationCount), texture);
+  }
+}
+
+PassMemoStats takePassMemoStats() {
+  const PassMemoStats stats = memoStats;
+  memoStats = PassMemoStats();
+  return stats;
+}
+
+static uint64_t textureHash(GLuint texture) {
+  auto it = textureContent.find(texture);
+  return it != textureContent.end() ? it->second
+                                    : hashBytes(&texture, sizeof(texture));
+}
+
+static uint64_t passInputHash(const RenderToTextureInfo &rtti, GLuint program,
+                              bool readsTime) {
+  uint64_t h = hashBytes(&program, sizeof(program));
+  h = hashBytes(&rtti.width, sizeof(rtti.width), h);
+  h = hashBytes(&rtti.height, sizeof(rtti.height), h);
+  h = hashBytes(&rtti.externalInputs, sizeof(rtti.externalInputs), h);
+  for (auto const &[name, val] : rtti.floatUniforms) {
+    h = hashString(name, h);
+    h = hashBytes(&val, sizeof(val), h);
+  }
+  if (readsTime && !rtti.floatUniforms.count("time")) {
+    const float time = (float)getFrameTime();
+    h = hashBytes(&time, sizeof(time), h);
+  }
+  for (auto const &[name, texture] : rtti.textureUniforms) {
+    h = hashString(name, h);
+    const uint64_t content = textureHash(texture);
+    h = hashBytes(&content, sizeof(content), h);
+  }
+  for (auto const &[name, texture] : rtti.cubemapUniforms) {
+    h = hashString(name, h);
+    const uint64_t content = textureHash(texture);
+    h = hashBytes(&content, sizeof(content), h);
+  }
+  return h;
+}
+
+void releaseFramebuffer(GLuint colorTexture) {
+  textureContent.erase(colorTexture);
+  auto it = textureFramebufferMap.find(colorTexture);
+  if (it != textureFramebufferMap.end()) {
+    glDeleteFramebuffers(1, &it->second);
+    textureFramebufferMap.erase(it);
+  }
+}
+
+GLuint getTextureFramebuffer(GLuint colorTexture) {
   // Lazy creation of a framebuffer as the render target and attach the texture
   // as the color attachment.
-  static std::map<GLuint, GLuint> textureFramebufferMap;
-  GLuint targetFramebuffer;
-  if (!textureFramebufferMap.count(rtti.targetTexture)) {
+  GLuint framebuffer;
+  if (!textureFramebufferMap.count(colorTexture)) {
     FramebufferCreateInfo createInfo;
-    createInfo.colorTexture = rtti.targetTexture;
-    targetFramebuffer = createFramebuffer(createInfo);
-    textureFramebufferMap[rtti.targetTexture] = targetFramebuffer;
+    createInfo.colorTexture = colorTexture;
+    framebuffer = createFramebuffer(createInfo);
+    textureFramebufferMap[colorTexture] = framebuffer;
   } else {
-    targetFramebuffer = textureFramebufferMap[rtti.targetTexture];
+    framebuffer = textureFramebufferMap[colorTexture];
   }
+  return framebuffer;
+}
+
+bool renderToTexture(const RenderToTextureInfo &rtti) {
+  GLuint targetFramebuffer = getTextureFramebuffer(rtti.targetTexture);
 
   // Lazy-load the shader program.
+  // Whether the program reads `time` is looked up once, not on every pass.
   static std::map<std::string, GLuint> shaderProgramMap;
+  static std::map<GLuint, bool> programReadsTime;
   GLuint program;
   if (!shaderProgramMap.count(rtti.fragShader)) {
     program = createShaderProgram(rtti.vertexShader, rtti.fragShader);
     shaderProgramMap[rtti.fragShader] = program;
+    programReadsTime[program] = glGetUniformLocation(program, "time") != -1;
   } else {
     program = shaderProgramMap[rtti.fragShader];
   }
 
+  uint64_t inputHash = 0;
+  if (memoization) {
+    inputHash = passInputHash(rtti, program, programReadsTime[program]);
+    memoStats.frameHash =
+        hashBytes(&inputHash, sizeof(inputHash), memoStats.frameHash);
+    auto it = textureContent.find(rtti.targetTexture);
+    if (it != textureContent.end() && it->second == inputHash) {
+      memoStats.skipped++;
+      return false;
+    }
+  }
+
+  const std::string name =
+      passTimer || isProfilerCapturing() ? passName(rtti) : std::string();
+  PROFILE_ZONE(name);
+  if (passTimer) {
+    passTimer->begin(name);
+  }
+
   // Rendering a quad.
   {
     glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
@@ -153,7 +279,7 @@ void renderToTexture(const RenderToTextureInfo &rtti) {
       glUniform2f(glGetUniformLocation(program, "resolution"),
                   (float)rtti.width, (float)rtti.height);
 
-      glUniform1f(glGetUniformLocation(program, "time"), (float)glfwGetTime());
+      glUniform1f(glGetUniformLocation(program, "time"), (float)getFrameTime());
 
       // Update float uniforms
       for (auto const &[name, val] : rtti.floatUniforms) {
@@ -181,4 +307,14 @@ void renderToTexture(const RenderToTextureInfo &rtti) {
 
     glUseProgram(0);
   }
+
+  if (passTimer) {
+    passTimer->end();
+  }
+
+  if (memoization) {
+    textureContent[rtti.targetTexture] = inputHash;
+  }
+  memoStats.rendered++;
+  return true;
 }
@@ -0,0 +1,240 @@
+#include <render_target_pool.h>
+
+#include <algorithm>
+
+#include <render.h>
+
+RenderTargetPool::~RenderTargetPool() { releaseAll(); }
+
+GLuint RenderTargetPool::get(const std::string &name, int width, int height,
+                             GLenum format) {
+  Target &target = targets[name];
+  if (target.texture && target.width == width && target.height == height &&
+      target.format == format) {
+    return target.texture;
+  }
+
+  destroy(target);
+  target.texture = createColorTexture(width, height, format);
+  target.width = width;
+  target.height = height;
+  target.format = format;
+  return target.texture;
+}
+
+void RenderTargetPool::release(const std::string &name) {
+  auto it = targets.find(name);
+  if (it != targets.end()) {
+    destroy(it->second);
+    targets.erase(it);
+  }
+}
+
+void RenderTargetPool::releaseAll() {
+  for (auto const &[name, target] : targets) {
+    destroy(target);
+  }
+  targets.clear();
+  for (const TransientTarget &transient : transients) {
+    destroy(transient);
+  }
+  transients.clear();
+}
+
+// Formats with the same texel size whose storage can be viewed as one
+// another (the view classes of ARB_texture_view), 0 for formats that only
+// share with themselves.
+static int viewClass(GLenum format) {
+  switch (format) {
+  case GL_RGB8:
+  case GL_SRGB8:
+    return 24;
+  case GL_R11F_G11F_B10F:
+  case GL_RGB9_E5:
+  case GL_RGBA8:
+  case GL_SRGB8_ALPHA8:
+  case GL_RGB10_A2:
+  case GL_RG16F:
+  case GL_R32F:
+    return 32;
+  case GL_RGB16F:
+    return 48;
+  case GL_RGBA16F:
+  case GL_RG32F:
+    return 64;
+  case GL_RGBA32F:
+    return 128;
+  default:
+    return 0;
+  }
+}
+
+static bool textureViewsSupported() {
+  return GLEW_ARB_texture_view && GLEW_ARB_texture_storage;
+}
+
+static void setLinearFiltering(GLuint texture) {
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+GLuint RenderTargetPool::transientTexture(TransientTarget &transient,
+                                          GLenum format) {
+  if (format == transient.target.format) {
+    return transient.target.texture;
+  }
+  GLuint &view = transient.views[format];
+  if (!view) {
+    glGenTextures(1, &view);
+    glTextureView(view, GL_TEXTURE_2D, transient.target.texture, format, 0, 1,
+                  0, 1);
+    setLinearFiltering(view);
+  }
+  return view;
+}
+
+GLuint RenderTargetPool::acquireTransient(int width, int height,
+                                          GLenum format) {
+  const bool views = textureViewsSupported();
+  TransientTarget *match = nullptr;
+  for (TransientTarget &transient : transients) {
+    const Target &target = transient.target;
+    if (transient.inUse || target.width != width || target.height != height) {
+      continue;
+    }
+    if (target.format == format) {
+      match = &transient;
+      break;
+    }
+    // Keep looking for an exact match, it needs no view.
+    if (!match && views && viewClass(format) != 0 &&
+        viewClass(format) == viewClass(target.format)) {
+      match = &transient;
+    }
+  }
+  if (!match) {
+    // Views need immutable storage.
+    TransientTarget transient;
+    if (views) {
+      glGenTextures(1, &transient.target.texture);
+      glBindTexture(GL_TEXTURE_2D, transient.target.texture);
+      glTexStorage2D(GL_TEXTURE_2D, 1, format, width, height);
+      glBindTexture(GL_TEXTURE_2D, 0);
+      setLinearFiltering(transient.target.texture);
+    } else {
+      transient.target.texture = createColorTexture(width, height, format);
+    }
+    transient.target.width = width;
+    transient.target.height = height;
+    transient.target.format = format;
+    transients.push_back(transient);
+    match = &transients.back();
+  }
+  match->inUse = true;
+  match->lastUsedFrame = frame;
+
+  // The pass about to draw overwrites what the other views of the storage
+  // hold, so their memoized content is gone.
+  const GLuint texture = transientTexture(*match, format);
+  if (match->target.texture != texture) {
+    markTextureModified(match->target.texture);
+  }
+  for (auto const &[viewFormat, view] : match->views) {
+    if (view != texture) {
+      markTextureModified(view);
+    }
+  }
+
+  Target requested = match->target;
+  requested.format = format;
+  frameStats.unaliasedBytes += targetBytes(requested);
+  frameStats.acquired++;
+  return texture;
+}
+
+void RenderTargetPool::releaseTransient(GLuint texture) {
+  for (TransientTarget &transient : transients) {
+    if (!transient.inUse) {
+      continue;
+    }
+    bool owns = transient.target.texture == texture;
+    for (auto const &[format, view] : transient.views) {
+      owns = owns || view == texture;
+    }
+    if (owns) {
+      transient.inUse = false;
+      return;
+    }
+  }
+}
+
+void RenderTargetPool::endTransientFrame() {
+  for (TransientTarget &transient : transients) {
+    transient.inUse = false;
+  }
+
+  auto unused = [this](const TransientTarget &transient) {
+    return frame - transient.lastUsedFrame >= TRANSIENT_KEEP_FRAMES;
+  };
+  for (const TransientTarget &transient : transients) {
+    if (unused(transient)) {
+      destroy(transient);
+    }
+  }
+  transients.erase(std::remove_if(transients.begin(), transients.end(), unused),
+                   transients.end());
+
+  for (const TransientTarget &transient : transients) {
+    frameStats.allocatedBytes += targetBytes(transient.target);
+  }
+  frameStats.textures = (int)transients.size();
+  lastFrameStats = frameStats;
+  frameStats = TransientStats();
+  frame++;
+}
+
+size_t RenderTargetPool::memoryUsage() const {
+  size_t bytes = 0;
+  for (auto const &[name, target] : targets) {
+    bytes += targetBytes(target);
+  }
+  for (const TransientTarget &transient : transients) {
+    bytes += targetBytes(transient.target);
+  }
+  return bytes;
+}
+
+size_t RenderTargetPool::targetBytes(const Target &target) {
+  // Three channel formats are usually padded to four by the driver.
+  size_t pixelBytes = 4;
+  switch (target.format) {
+  case GL_RGB16F:
+  case GL_RGBA16F:
+    pixelBytes = 8;
+    break;
+  case GL_RGB32F:
+  case GL_RGBA32F:
+    pixelBytes = 16;
+    break;
+  default: // GL_R11F_G11F_B10F, GL_RGB8, GL_RGBA8, GL_SRGB8_ALPHA8, ...
+    break;
+  }
+  return (size_t)target.width * target.height * pixelBytes;
+}
+
+void RenderTargetPool::destroy(const Target &target) {
+  if (target.texture) {
+    releaseFramebuffer(target.texture);
+    glDeleteTextures(1, &target.texture);
+  }
+}
+
+void RenderTargetPool::destroy(const TransientTarget &transient) {
+  for (auto const &[format, view] : transient.views) {
+    releaseFramebuffer(view);
+    glDeleteTextures(1, &view);
+  }
+  destroy(transient.target);
+}
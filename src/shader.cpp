@@ -7,6 +7,7 @@
 #include <vector>
 
 #include <GL/glew.h>
+#include <gl_stats.h>
 
 static std::string readFile(const std::string &file) {
   std::string VertexShaderCode;
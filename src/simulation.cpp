@@ -0,0 +1,146 @@
+#include <simulation.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include <frame_clock.h>
+#include <perf_counters.h>
+#include <profiler.h>
+
+// The orbit the shader used to compute from `time`.
+static const double ORBIT_SPEED = 0.1; // Radians per second.
+static const float ORBIT_RADIUS = 15.0f;
+
+// After a stall (debugger, suspended machine) the thread skips ahead instead
+// of replaying every missed tick.
+static const int MAX_CATCH_UP_TICKS = 8;
+
+// Particle orbits take minutes at the physical rate; adiskSpeed 0.5 runs
+// them 10 times faster.
+static const float PARTICLE_TIME_SCALE = 20.0f;
+
+static glm::vec3 orbitPosition(double time) {
+  const float angle = (float)(time * ORBIT_SPEED);
+  return glm::vec3(-cosf(angle), sinf(angle), sinf(angle)) * ORBIT_RADIUS;
+}
+
+SimulationState interpolate(const SimulationState &a, const SimulationState &b,
+                            float t) {
+  SimulationState result;
+  result.time = a.time + (b.time - a.time) * t;
+  result.cameraOrbit = glm::mix(a.cameraOrbit, b.cameraOrbit, t);
+  result.adiskPhase = a.adiskPhase + (b.adiskPhase - a.adiskPhase) * t;
+  return result;
+}
+
+Simulation::Simulation(double tickRate) : interval(1.0 / tickRate) {
+  reset(0.0);
+}
+
+Simulation::~Simulation() { stop(); }
+
+void Simulation::reset(double time) {
+  state = SimulationState();
+  state.time = time;
+  state.cameraOrbit = orbitPosition(time);
+  state.adiskPhase = (float)(time * diskSpeed.load(std::memory_order_relaxed));
+  snapshots.writeBuffer() = state;
+  snapshots.publish();
+  previous = state;
+  current = state;
+}
+
+void Simulation::start() {
+  if (simulationThread.joinable()) {
+    return;
+  }
+  stopRequested = false;
+  simulationThread = std::thread(&Simulation::simulationThreadFunc, this);
+}
+
+void Simulation::stop() {
+  if (!simulationThread.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(stopMutex);
+    stopRequested = true;
+  }
+  stopCondition.notify_one();
+  simulationThread.join();
+}
+
+void Simulation::advanceTo(double time) {
+  while (state.time + interval <= time) {
+    tick();
+  }
+}
+
+void Simulation::tick() {
+  PROFILE_ZONE("simulationTick");
+  state.time += interval;
+  state.cameraOrbit = orbitPosition(state.time);
+  state.adiskPhase +=
+      diskSpeed.load(std::memory_order_relaxed) * (float)interval;
+  tickParticles();
+
+  snapshots.writeBuffer() = state;
+  snapshots.publish();
+}
+
+void Simulation::tickParticles() {
+  const int count = particleCount.load(std::memory_order_relaxed);
+  const bool relativistic =
+      particlesRelativistic.load(std::memory_order_relaxed);
+  if (count != diskParticles.size() || relativistic != seededRelativistic) {
+    PROFILE_ZONE("seedParticles");
+    diskParticles.seed(count, relativistic);
+    seededRelativistic = relativistic;
+  } else if (count == 0) {
+    return;
+  }
+
+  PROFILE_ZONE("stepParticles");
+  const float timeScale =
+      diskSpeed.load(std::memory_order_relaxed) * PARTICLE_TIME_SCALE;
+  ParticleSnapshot &snapshot = particleSnapshots.writeBuffer();
+  diskParticles.step((float)interval * timeScale, relativistic, timeScale,
+                 snapshot);
+  snapshot.time = state.time;
+  particleSnapshots.publish();
+}
+
+SimulationState Simulation::sample(double time) {
+  if (snapshots.update()) {
+    previous = current;
+    current = snapshots.readBuffer();
+  }
+  const double span = current.time - previous.time;
+  if (span <= 0.0) {
+    return current;
+  }
+  const double t = (time - interval - previous.time) / span;
+  return interpolate(previous, current, (float)std::clamp(t, 0.0, 1.0));
+}
+
+void Simulation::simulationThreadFunc() {
+  setProfilerThreadName("simulation");
+  registerPerfCounterThread("simulation");
+
+  std::unique_lock<std::mutex> lock(stopMutex);
+  while (!stopRequested) {
+    lock.unlock();
+    const double now = getFrameTime();
+    if (now - state.time > MAX_CATCH_UP_TICKS * interval) {
+      state.time = now - interval;
+    }
+    advanceTo(now);
+    lock.lock();
+
+    const double wait = state.time + interval - getFrameTime();
+    stopCondition.wait_for(lock,
+                           std::chrono::duration<double>(std::max(wait, 0.0)),
+                           [this] { return stopRequested; });
+  }
+}
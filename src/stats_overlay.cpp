@@ -1,19 +1,16 @@
 #include "stats_overlay.h"
+#include "gl_stats.h"
+#include "gpu_timer.h"
+#include "perf_counters.h"
+#include "telemetry.h"
+#include "work_counters.h"
 #include "imgui.h"
 #include <GL/glew.h>  // Required for glGetString, glGetIntegerv, etc.
 
-#ifdef __linux__
-#include <sys/sysinfo.h>
-#include <fstream>
-#include <string>
+#include <algorithm>
+#include <cstdio>
 #include <cstring> // For strstr
-#include <cstdio>  // For popen, fgets, pclose
-#include <sstream> // For stringstream
-#endif
-
-#ifdef USE_NVML
-#include <nvml.h>
-#endif
+#include <string>
 
 // Timer variables (using ImGui::GetTime)
 static float lastUpdateTime = 0.0f;
@@ -21,27 +18,30 @@ static float updateInterval = 1.0f; // Update every ~1 second
 
 // Variables for stats
 static float currentFPS = 0.0f;
-static int currentRAM = 0;
-static int currentGPUUsage = 0;
-static int currentTemp = 0;
-
-#ifdef __linux__
-// Retrieve RAM usage in MB using sysinfo.
-static int GetRAMUsageMB()
-{
-    struct sysinfo memInfo;
-    if (sysinfo(&memInfo) == 0)
-    {
-        long long totalMem = memInfo.totalram * memInfo.mem_unit;
-        long long freeMem  = memInfo.freeram  * memInfo.mem_unit;
-        int usedMB = (totalMem - freeMem) / (1024 * 1024);
-        return usedMB;
-    }
-    return 0;
-}
-
-// Original method using OpenGL extension (may not work under WSL)
-static int GetGPUUsagePercent_OpenGL()
+static int currentVRAMUsage = -1;
+
+// Ring of the most recent per-frame times.
+static const int FRAME_HISTORY = 512;
+static float cpuFrameTimes[FRAME_HISTORY];
+static float gpuFrameTimes[FRAME_HISTORY];
+static int frameHistoryHead = 0;  // Next slot to write, also the oldest entry once full.
+static int frameHistoryCount = 0;
+static long long recordedFrames = 0;
+
+// A hitch is a frame taking more than HITCH_FACTOR times the moving average.
+static const float HITCH_FACTOR = 2.0f;
+static float averageFrameMs = 0.0f;
+static int hitchCount = 0;
+
+static std::string frameTimesStatus;
+
+// Process, system and GPU statistics are sampled on a background thread,
+// so nothing here can stall the frame.
+static TelemetryCollector telemetry;
+
+// GPU memory usage through an OpenGL extension (NVIDIA only). Needs the GL
+// context, so it stays on the render thread; it is a cheap state query.
+static int GetVRAMUsagePercent_OpenGL()
 {
     const char* extensions = reinterpret_cast<const char*>(glGetString(GL_EXTENSIONS));
     if (extensions && strstr(extensions, "GL_NVX_gpu_memory_info"))
@@ -56,143 +56,120 @@ static int GetGPUUsagePercent_OpenGL()
             return (usedMemoryKB * 100) / totalMemoryKB;
         }
     }
-    return 0;
+    return -1;
 }
 
-#ifdef USE_NVML
-// Retrieve GPU usage percentage using NVML.
-static int GetNVMLGPUUsagePercent()
+static void UpdateStats()
 {
-    nvmlReturn_t result = nvmlInit();
-    if (result != NVML_SUCCESS)
-        return 0;
-    nvmlDevice_t device;
-    result = nvmlDeviceGetHandleByIndex(0, &device);
-    if (result != NVML_SUCCESS) {
-        nvmlShutdown();
-        return 0;
-    }
-    nvmlUtilization_t utilization;
-    result = nvmlDeviceGetUtilizationRates(device, &utilization);
-    if (result != NVML_SUCCESS) {
-        nvmlShutdown();
-        return 0;
+    telemetry.start(updateInterval);
+
+    float currentTime = ImGui::GetTime();
+    if (currentTime - lastUpdateTime > updateInterval)
+    {
+        currentFPS = ImGui::GetIO().Framerate;
+        currentVRAMUsage = GetVRAMUsagePercent_OpenGL();
+        lastUpdateTime = currentTime;
     }
-    int usage = utilization.gpu;
-    nvmlShutdown();
-    return usage;
 }
 
-// Retrieve GPU temperature using NVML.
-static int GetNVMLGPUTemperature()
+void RecordFrameTimes(float cpuMs, float gpuMs)
 {
-    nvmlReturn_t result = nvmlInit();
-    if (result != NVML_SUCCESS)
-        return 0;
-    nvmlDevice_t device;
-    result = nvmlDeviceGetHandleByIndex(0, &device);
-    if (result != NVML_SUCCESS) {
-        nvmlShutdown();
-        return 0;
-    }
-    unsigned int temp;
-    result = nvmlDeviceGetTemperature(device, NVML_TEMPERATURE_GPU, &temp);
-    if (result != NVML_SUCCESS) {
-        nvmlShutdown();
-        return 0;
-    }
-    nvmlShutdown();
-    return static_cast<int>(temp);
+    if (recordedFrames > 0 && cpuMs > HITCH_FACTOR * averageFrameMs)
+        hitchCount++;
+    averageFrameMs = recordedFrames == 0 ? cpuMs : 0.95f * averageFrameMs + 0.05f * cpuMs;
+
+    cpuFrameTimes[frameHistoryHead] = cpuMs;
+    gpuFrameTimes[frameHistoryHead] = gpuMs;
+    frameHistoryHead = (frameHistoryHead + 1) % FRAME_HISTORY;
+    frameHistoryCount = std::min(frameHistoryCount + 1, FRAME_HISTORY);
+    recordedFrames++;
 }
-#endif // USE_NVML
 
-// Alternative method: query using nvidia-smi via popen.
-#ifdef __linux__
-static int GetGPUUsagePercent_Smi()
+bool DumpFrameTimes(const char* file)
 {
-    FILE* pipe = popen("nvidia-smi --query-gpu=utilization.gpu --format=csv,noheader,nounits", "r");
-    if (!pipe)
-        return 0;
-    char buffer[128];
-    std::string result = "";
-    while (fgets(buffer, sizeof(buffer), pipe) != NULL)
+    FILE* out = fopen(file, "w");
+    if (!out)
+        return false;
+    fprintf(out, "frame,cpu_ms,gpu_ms\n");
+    const int oldest = (frameHistoryHead - frameHistoryCount + FRAME_HISTORY) % FRAME_HISTORY;
+    for (int i = 0; i < frameHistoryCount; i++)
     {
-        result += buffer;
-    }
-    pclose(pipe);
-    try {
-        return std::stoi(result);
-    } catch(...) {
-        return 0;
+        int index = (oldest + i) % FRAME_HISTORY;
+        fprintf(out, "%lld,%.4f,%.4f\n", recordedFrames - frameHistoryCount + i,
+                cpuFrameTimes[index], gpuFrameTimes[index]);
     }
+    fclose(out);
+    return true;
 }
 
-static int GetGPUTemperature_Smi()
+struct FramePercentiles
 {
-    FILE* pipe = popen("nvidia-smi --query-gpu=temperature.gpu --format=csv,noheader,nounits", "r");
-    if (!pipe)
-        return 0;
-    char buffer[128];
-    std::string result = "";
-    while (fgets(buffer, sizeof(buffer), pipe) != NULL)
-    {
-        result += buffer;
-    }
-    pclose(pipe);
-    try {
-        return std::stoi(result);
-    } catch(...) {
-        return 0;
-    }
+    float p50 = 0.0f, p95 = 0.0f, p99 = 0.0f, max = 0.0f;
+};
+
+// Nearest-rank percentiles of the valid part of a frame time ring.
+static FramePercentiles ComputePercentiles(const float* times)
+{
+    FramePercentiles result;
+    if (frameHistoryCount == 0)
+        return result;
+    float sorted[FRAME_HISTORY];
+    std::copy(times, times + frameHistoryCount, sorted);
+    std::sort(sorted, sorted + frameHistoryCount);
+    auto rank = [&](float p) {
+        int index = (int)(p * frameHistoryCount + 0.999f) - 1;
+        return sorted[std::min(std::max(index, 0), frameHistoryCount - 1)];
+    };
+    result.p50 = rank(0.50f);
+    result.p95 = rank(0.95f);
+    result.p99 = rank(0.99f);
+    result.max = sorted[frameHistoryCount - 1];
+    return result;
 }
-#endif
 
-// Retrieve CPU temperature by reading from sysfs (in millidegrees Celsius).
-static int GetCPUTemperature()
+static void RenderFrameTimes()
 {
-    std::ifstream file("/sys/class/thermal/thermal_zone0/temp");
-    if (file.is_open())
+    if (!ImGui::CollapsingHeader("Frame times"))
+        return;
+
+    // Once the ring is full the oldest entry sits at the write head.
+    const int offset = frameHistoryCount == FRAME_HISTORY ? frameHistoryHead : 0;
+    const FramePercentiles cpu = ComputePercentiles(cpuFrameTimes);
+    const FramePercentiles gpu = ComputePercentiles(gpuFrameTimes);
+    const float plotMax = std::max(cpu.max, gpu.max) * 1.1f;
+
+    std::string overlay = "p99 " + std::to_string((int)(cpu.p99 + 0.5f)) + " ms";
+    ImGui::PlotLines("CPU", cpuFrameTimes, frameHistoryCount, offset, overlay.c_str(),
+                     0.0f, plotMax, ImVec2(260, 60));
+    overlay = "p99 " + std::to_string((int)(gpu.p99 + 0.5f)) + " ms";
+    ImGui::PlotLines("GPU", gpuFrameTimes, frameHistoryCount, offset, overlay.c_str(),
+                     0.0f, plotMax, ImVec2(260, 60));
+
+    ImGui::Text("     p50    p95    p99    max");
+    ImGui::Text("CPU %6.2f %6.2f %6.2f %6.2f", cpu.p50, cpu.p95, cpu.p99, cpu.max);
+    ImGui::Text("GPU %6.2f %6.2f %6.2f %6.2f", gpu.p50, gpu.p95, gpu.p99, gpu.max);
+    ImGui::Text("Hitches: %d (> %.0fx average)", hitchCount, HITCH_FACTOR);
+
+    if (ImGui::Button("Dump frame times"))
     {
-        int temp;
-        file >> temp;
-        file.close();
-        return temp / 1000; // Convert to degrees Celsius.
+        std::string file = "frame_times_" + std::to_string(recordedFrames) + ".csv";
+        frameTimesStatus = DumpFrameTimes(file.c_str()) ? "Wrote " + file
+                                                        : "ERROR: Failed to write " + file;
     }
-    return 0;
+    if (!frameTimesStatus.empty())
+        ImGui::TextUnformatted(frameTimesStatus.c_str());
 }
-#endif
 
-static void UpdateStats()
+// Prints "label: value unit", or "label: n/a" for values that could not be read.
+static void StatText(const char* label, int value, const char* unit)
 {
-    float currentTime = ImGui::GetTime();
-    if (currentTime - lastUpdateTime > updateInterval)
-    {
-        currentFPS = ImGui::GetIO().Framerate;
-#ifdef __linux__
-        currentRAM = GetRAMUsageMB();
-#ifdef USE_NVML
-        int gpuUsage = GetNVMLGPUUsagePercent();
-        int gpuTemp = GetNVMLGPUTemperature();
-        if (gpuUsage == 0)
-            gpuUsage = GetGPUUsagePercent_Smi();
-        if (gpuTemp == 0)
-            gpuTemp = GetGPUTemperature_Smi();
-        currentGPUUsage = gpuUsage;
-        currentTemp = gpuTemp;
-#else
-        currentGPUUsage = GetGPUUsagePercent_OpenGL();
-        currentTemp = GetCPUTemperature();
-#endif
-#else
-        currentRAM = 4096;
-        currentGPUUsage = 70;
-        currentTemp = 55;
-#endif
-        lastUpdateTime = currentTime;
-    }
+    if (value < 0)
+        ImGui::Text("%s: n/a", label);
+    else
+        ImGui::Text("%s: %d%s", label, value, unit);
 }
 
-void RenderStatsOverlay()
+void RenderStatsOverlay(const GpuTimer* gpuTimer, const GpuWorkCounters* workCounters)
 {
     UpdateStats();
 
@@ -209,10 +186,63 @@ void RenderStatsOverlay()
         ImGuiWindowFlags_NoResize |
         ImGuiWindowFlags_NoMove);
 
+    const TelemetrySnapshot& stats = telemetry.latest();
+
     ImGui::Text("FPS: %.1f", currentFPS);
-    ImGui::Text("RAM: %d MB", currentRAM);
-    ImGui::Text("GPU Usage: %d%%", currentGPUUsage);
-    ImGui::Text("Temp: %d C", currentTemp);
+    StatText("RAM", stats.systemRamUsedMB, " MB");
+    StatText("Process RSS", stats.processRssMB, " MB");
+    StatText("Peak RSS", stats.processPeakRssMB, " MB");
+    if (stats.processCpuPercent < 0.0f)
+        ImGui::Text("CPU: n/a");
+    else
+        ImGui::Text("CPU: %.0f%% (%d threads)", stats.processCpuPercent, stats.processThreads);
+    StatText("CPU Temp", stats.cpuTemperature, " C");
+    StatText("GPU Usage", stats.gpuUsagePercent, "%");
+    StatText("GPU Temp", stats.gpuTemperature, " C");
+    StatText("VRAM", currentVRAMUsage, "%");
+    if (stats.powerWatts >= 0.0f && currentFPS > 0.0f)
+        ImGui::Text("Power: %.1f W (%.1f mJ/frame)", stats.powerWatts,
+                    1000.0f * stats.powerWatts / currentFPS);
+
+    ImGui::Separator();
+    RenderFrameTimes();
+
+    // Hardware counters of the last frame, per registered thread.
+    if (perfCountersEnabled() && ImGui::CollapsingHeader("CPU counters"))
+    {
+        ImGui::Text("%-12s %8s %5s %7s %7s", "thread", "Mcycles", "IPC", "cache%", "branch%");
+        for (const ThreadPerfCounters& thread : perfCounterSnapshot())
+            ImGui::Text("%-12s %8.2f %5.2f %6.1f%% %6.2f%%", thread.name.c_str(),
+                        thread.frame.cycles / 1.0e6, thread.frame.ipc(),
+                        100.0 * thread.frame.cacheMissRate(),
+                        100.0 * thread.frame.branchMissRate());
+    }
+
+    // Per-pass GPU times, a few frames behind the CPU.
+    if (gpuTimer && !gpuTimer->orderedPassTimes().empty())
+    {
+        ImGui::Separator();
+        ImGui::Text("GPU: %.2f ms", gpuTimer->frameMs());
+        for (const auto& [name, ms] : gpuTimer->orderedPassTimes())
+            ImGui::Text("  %-20s %6.2f ms", name.c_str(), ms);
+    }
+
+    // GL calls made by the renderer during the previous frame.
+    if (glCallStatsEnabled() && ImGui::CollapsingHeader("GL calls"))
+    {
+        for (const auto& [name, count] : glCallStatsFields(previousGlStatsFrame()))
+            ImGui::Text("  %-20s %6d", name, count);
+    }
+
+    // Work counted by the shaders, a few frames behind the CPU.
+    if (workCounters)
+    {
+        const uint32_t* counters = workCounters->latest();
+        ImGui::Separator();
+        ImGui::Text("GPU work:");
+        for (int i = 0; i < GpuWorkCounters::COUNTER_COUNT; i++)
+            ImGui::Text("  %-20s %10u", GpuWorkCounters::COUNTER_NAMES[i], counters[i]);
+    }
 
     // Debug: Display last update time to verify refreshing.
     // ImGui::Text("Last update: %.1f", lastUpdateTime);
@@ -0,0 +1,269 @@
+#include <telemetry.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef __linux__
+#include <sys/sysinfo.h>
+#include <unistd.h>
+#endif
+
+#ifdef USE_NVML
+#include <nvml.h>
+
+static nvmlDevice_t nvmlDevice;
+#endif
+
+static bool readUint64(const std::string &file, uint64_t &value) {
+  std::ifstream ifs(file);
+  return (bool)(ifs >> value);
+}
+
+bool EnergyCounter::open() {
+  domains.clear();
+  total = 0.0;
+  std::vector<Domain> packages;
+  for (int index = 0;; index++) {
+    const std::string dir =
+        "/sys/class/powercap/intel-rapl:" + std::to_string(index) + "/";
+    std::ifstream nameFile(dir + "name");
+    if (!nameFile.is_open()) {
+      break;
+    }
+    std::string name;
+    nameFile >> name;
+
+    Domain domain;
+    domain.energyFile = dir + "energy_uj";
+    if (!readUint64(dir + "max_energy_range_uj", domain.maxRange) ||
+        !readUint64(domain.energyFile, domain.last)) {
+      continue;
+    }
+    if (name == "psys") {
+      domains = {domain};
+      return true;
+    }
+    packages.push_back(domain);
+  }
+  domains = packages;
+  return !domains.empty();
+}
+
+double EnergyCounter::joules() {
+  for (Domain &domain : domains) {
+    uint64_t value = 0;
+    if (!readUint64(domain.energyFile, value)) {
+      continue;
+    }
+    const uint64_t delta = value >= domain.last
+                               ? value - domain.last
+                               : domain.maxRange - domain.last + value;
+    total += delta / 1.0e6;
+    domain.last = value;
+  }
+  return total;
+}
+
+TelemetryCollector::~TelemetryCollector() { stop(); }
+
+void TelemetryCollector::start(double intervalSeconds) {
+  if (samplerThread.joinable()) {
+    return;
+  }
+  interval = intervalSeconds;
+  stopRequested = false;
+  samplerThread = std::thread(&TelemetryCollector::samplerThreadFunc, this);
+}
+
+void TelemetryCollector::stop() {
+  if (!samplerThread.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(stopMutex);
+    stopRequested = true;
+  }
+  stopCondition.notify_one();
+  samplerThread.join();
+}
+
+const TelemetrySnapshot &TelemetryCollector::latest() {
+  snapshots.update();
+  return snapshots.readBuffer();
+}
+
+void TelemetryCollector::samplerThreadFunc() {
+#ifdef USE_NVML
+  // Initialized once for the lifetime of the thread instead of per query.
+  nvmlAvailable = nvmlInit() == NVML_SUCCESS &&
+                  nvmlDeviceGetHandleByIndex(0, &nvmlDevice) == NVML_SUCCESS;
+#endif
+  energy.open();
+
+  std::unique_lock<std::mutex> lock(stopMutex);
+  while (!stopRequested) {
+    lock.unlock();
+    TelemetrySnapshot &snapshot = snapshots.writeBuffer();
+    snapshot = TelemetrySnapshot();
+    sample(snapshot);
+    snapshots.publish();
+    lock.lock();
+
+    stopCondition.wait_for(lock, std::chrono::duration<double>(interval),
+                           [this] { return stopRequested; });
+  }
+
+#ifdef USE_NVML
+  nvmlShutdown();
+#endif
+}
+
+#ifdef __linux__
+// Value in kB of a "Key:   1234 kB" line of /proc/self/status.
+static int readStatusKB(const std::string &status, const char *key) {
+  size_t pos = status.find(key);
+  if (pos == std::string::npos) {
+    return -1;
+  }
+  return atoi(status.c_str() + pos + strlen(key));
+}
+
+// Hottest of /sys/class/thermal/thermal_zone*/temp in degrees Celsius.
+static int readMaxThermalZone() {
+  int maxTemp = -1;
+  for (int zone = 0;; zone++) {
+    std::ifstream file("/sys/class/thermal/thermal_zone" +
+                       std::to_string(zone) + "/temp");
+    if (!file.is_open()) {
+      break;
+    }
+    int milliCelsius = 0;
+    if (file >> milliCelsius) {
+      maxTemp = std::max(maxTemp, milliCelsius / 1000);
+    }
+  }
+  return maxTemp;
+}
+
+// Runs nvidia-smi once for both utilization and temperature. Returns false
+// if it is not installed, so that the caller stops trying.
+static bool querySmi(int &usage, int &temperature) {
+  FILE *pipe = popen("nvidia-smi --query-gpu=utilization.gpu,temperature.gpu "
+                     "--format=csv,noheader,nounits 2>/dev/null",
+                     "r");
+  if (!pipe) {
+    return false;
+  }
+  char buffer[128] = {};
+  bool ok = fgets(buffer, sizeof(buffer), pipe) != nullptr &&
+            sscanf(buffer, "%d, %d", &usage, &temperature) == 2;
+  pclose(pipe);
+  return ok;
+}
+#endif
+
+void TelemetryCollector::sample(TelemetrySnapshot &snapshot) {
+  const double wallSeconds =
+      std::chrono::duration<double>(
+          std::chrono::steady_clock::now().time_since_epoch())
+          .count();
+
+  if (energy.isOpen()) {
+    const double joules = energy.joules();
+    if (lastWallSeconds > 0.0 && wallSeconds > lastWallSeconds) {
+      snapshot.powerWatts =
+          (float)((joules - lastJoules) / (wallSeconds - lastWallSeconds));
+    }
+    lastJoules = joules;
+  }
+
+#ifdef __linux__
+  struct sysinfo memInfo;
+  if (sysinfo(&memInfo) == 0) {
+    long long totalMem = (long long)memInfo.totalram * memInfo.mem_unit;
+    long long freeMem = (long long)memInfo.freeram * memInfo.mem_unit;
+    snapshot.systemRamUsedMB = (int)((totalMem - freeMem) / (1024 * 1024));
+  }
+
+  {
+    std::ifstream file("/proc/self/status");
+    std::stringstream ss;
+    ss << file.rdbuf();
+    const std::string status = ss.str();
+    int rss = readStatusKB(status, "VmRSS:");
+    int hwm = readStatusKB(status, "VmHWM:");
+    snapshot.processRssMB = rss < 0 ? -1 : rss / 1024;
+    snapshot.processPeakRssMB = hwm < 0 ? -1 : hwm / 1024;
+  }
+
+  {
+    // Fields after the parenthesized command name; utime and stime are
+    // fields 14 and 15, num_threads is field 20.
+    std::ifstream file("/proc/self/stat");
+    std::string stat((std::istreambuf_iterator<char>(file)),
+                     std::istreambuf_iterator<char>());
+    size_t commEnd = stat.rfind(')');
+    if (commEnd != std::string::npos) {
+      std::istringstream fields(stat.substr(commEnd + 2));
+      std::string field;
+      unsigned long long utime = 0, stime = 0;
+      long threads = -1;
+      for (int i = 3; fields >> field; i++) {
+        if (i == 14) {
+          utime = std::stoull(field);
+        } else if (i == 15) {
+          stime = std::stoull(field);
+        } else if (i == 20) {
+          threads = std::stol(field);
+          break;
+        }
+      }
+      snapshot.processThreads = (int)threads;
+
+      const double cpuSeconds =
+          (double)(utime + stime) / (double)sysconf(_SC_CLK_TCK);
+      if (lastCpuSeconds >= 0.0 && wallSeconds > lastWallSeconds) {
+        snapshot.processCpuPercent =
+            (float)(100.0 * (cpuSeconds - lastCpuSeconds) /
+                    (wallSeconds - lastWallSeconds));
+      }
+      lastCpuSeconds = cpuSeconds;
+    }
+  }
+
+  snapshot.cpuTemperature = readMaxThermalZone();
+#endif
+
+#ifdef USE_NVML
+  if (nvmlAvailable) {
+    nvmlUtilization_t utilization;
+    if (nvmlDeviceGetUtilizationRates(nvmlDevice, &utilization) ==
+        NVML_SUCCESS) {
+      snapshot.gpuUsagePercent = (int)utilization.gpu;
+    }
+    unsigned int temp;
+    if (nvmlDeviceGetTemperature(nvmlDevice, NVML_TEMPERATURE_GPU, &temp) ==
+        NVML_SUCCESS) {
+      snapshot.gpuTemperature = (int)temp;
+    }
+  }
+#endif
+
+#ifdef __linux__
+  if (!nvmlAvailable && smiAvailable) {
+    int usage = -1, temperature = -1;
+    smiAvailable = querySmi(usage, temperature);
+    if (smiAvailable) {
+      snapshot.gpuUsagePercent = usage;
+      snapshot.gpuTemperature = temperature;
+    }
+  }
+#endif
+
+  lastWallSeconds = wallSeconds;
+}
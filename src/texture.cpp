@@ -1,8 +1,14 @@
 #include <texture.h>
+#include <gl_stats.h>
+#include <job_system.h>
 
+#include <cstdint>
+#include <fstream>
 #include <iostream>
 #include <vector>
 
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
 #include <stb_image.h>
 
 GLuint loadTexture2D(const std::string &file, bool repeat) {
@@ -47,27 +53,85 @@ GLuint loadTexture2D(const std::string &file, bool repeat) {
   return textureID;
 }
 
-GLuint loadCubemap(const std::string &cubemapDir) {
+struct CubemapFace {
+  std::string path;
+  int width = 0;
+  int height = 0;
+  std::vector<unsigned char> ldr;
+  std::vector<uint32_t> packed; // Shared-exponent or packed-float texels.
+};
+
+// Decodes one face on a worker thread. HDR faces are packed to 32 bits per
+// texel here so the upload (and the copy in VRAM) is a third of RGB32F.
+static void decodeCubemapFace(CubemapFace &face, bool hdr, GLenum hdrFormat) {
+  int comp;
+  if (hdr) {
+    float *data =
+        stbi_loadf(face.path.c_str(), &face.width, &face.height, &comp, 3);
+    if (!data) {
+      return;
+    }
+    const size_t count = (size_t)face.width * face.height;
+    face.packed.resize(count);
+    for (size_t i = 0; i < count; i++) {
+      glm::vec3 texel(data[i * 3 + 0], data[i * 3 + 1], data[i * 3 + 2]);
+      face.packed[i] = hdrFormat == GL_R11F_G11F_B10F
+                           ? glm::packF2x11_1x10(texel)
+                           : glm::packF3x9_E1x5(texel);
+    }
+    stbi_image_free(data);
+  } else {
+    unsigned char *data =
+        stbi_load(face.path.c_str(), &face.width, &face.height, &comp, 3);
+    if (!data) {
+      return;
+    }
+    face.ldr.assign(data, data + (size_t)face.width * face.height * 3);
+    stbi_image_free(data);
+  }
+}
+
+GLuint loadCubemap(const std::string &cubemapDir, GLenum hdrFormat) {
   const std::vector<std::string> faces = {"right",  "left",  "top",
                                           "bottom", "front", "back"};
 
+  // Prefer Radiance .hdr faces when present, otherwise fall back to 8-bit PNG.
+  const bool hdr = std::ifstream(cubemapDir + "/" + faces[0] + ".hdr").good();
+  if (hdrFormat != GL_R11F_G11F_B10F) {
+    hdrFormat = GL_RGB9_E5;
+  }
+
+  // Decode all six faces on the job system; only the upload needs the GL
+  // context.
+  std::vector<CubemapFace> decoded(faces.size());
+  for (size_t i = 0; i < faces.size(); i++) {
+    decoded[i].path = cubemapDir + "/" + faces[i] + (hdr ? ".hdr" : ".png");
+  }
+  jobSystem().parallelFor((int)decoded.size(), 1, [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      decodeCubemapFace(decoded[i], hdr, hdrFormat);
+    }
+  });
+
   GLuint textureID;
   glGenTextures(1, &textureID);
   glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
-  int width, height, comp;
-  for (GLuint i = 0; i < faces.size(); i++) {
-    unsigned char *data =
-        stbi_load((cubemapDir + "/" + faces[i] + ".png").c_str(), &width,
-                  &height, &comp, 0);
-    if (data) {
-      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_SRGB, width,
-                   height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-      stbi_image_free(data);
+  for (GLuint i = 0; i < decoded.size(); i++) {
+    const CubemapFace &face = decoded[i];
+    if (hdr && !face.packed.empty()) {
+      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, hdrFormat,
+                   face.width, face.height, 0, GL_RGB,
+                   hdrFormat == GL_R11F_G11F_B10F
+                       ? GL_UNSIGNED_INT_10F_11F_11F_REV
+                       : GL_UNSIGNED_INT_5_9_9_9_REV,
+                   face.packed.data());
+    } else if (!hdr && !face.ldr.empty()) {
+      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_SRGB, face.width,
+                   face.height, 0, GL_RGB, GL_UNSIGNED_BYTE, face.ldr.data());
     } else {
-      std::cout << "Cubemap texture failed to load at path: "
-                << (cubemapDir + "/" + faces[i] + ".png").c_str() << std::endl;
-      stbi_image_free(data);
+      std::cout << "Cubemap texture failed to load at path: " << face.path
+                << std::endl;
     }
   }
   glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
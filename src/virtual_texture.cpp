@@ -0,0 +1,500 @@
+#include <virtual_texture.h>
+#include <perf_counters.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+
+#include <stb_image.h>
+
+static const char VT_MAGIC[4] = {'B', 'H', 'V', 'T'};
+static const uint32_t VT_VERSION = 1;
+static const uint32_t VT_BORDER = 1;
+static const uint64_t VT_NO_TILE = ~0ull;
+
+static bool isPowerOfTwo(int v) { return v > 0 && (v & (v - 1)) == 0; }
+
+// Number of pyramid levels until the whole level fits into a single tile.
+static int countLevels(int width, int height, int tileSize) {
+  int levels = 1;
+  while ((width >> (levels - 1)) > tileSize ||
+         (height >> (levels - 1)) > tileSize) {
+    levels++;
+  }
+  return levels;
+}
+
+bool buildVirtualTextureFile(const std::string &imageFile,
+                             const std::string &vtFile, int tileSize) {
+  int width, height, comp;
+  unsigned char *data = stbi_load(imageFile.c_str(), &width, &height, &comp, 3);
+  if (!data) {
+    std::cout << "ERROR: Failed to load panorama at: " << imageFile
+              << std::endl;
+    return false;
+  }
+  if (!isPowerOfTwo(width) || !isPowerOfTwo(height) ||
+      !isPowerOfTwo(tileSize)) {
+    std::cout << "ERROR: Panorama and tile size must be powers of two: "
+              << imageFile << " is " << width << "x" << height << std::endl;
+    stbi_image_free(data);
+    return false;
+  }
+
+  std::ofstream ofs(vtFile, std::ios::out | std::ios::binary);
+  if (!ofs.is_open()) {
+    std::cout << "ERROR: Failed to open file: " << vtFile << std::endl;
+    stbi_image_free(data);
+    return false;
+  }
+
+  const int levels = countLevels(width, height, tileSize);
+  const int border = VT_BORDER;
+  const int physicalSize = tileSize + 2 * border;
+
+  uint32_t header[7];
+  memcpy(&header[0], VT_MAGIC, 4);
+  header[1] = VT_VERSION;
+  header[2] = width;
+  header[3] = height;
+  header[4] = tileSize;
+  header[5] = border;
+  header[6] = levels;
+  ofs.write(reinterpret_cast<const char *>(header), sizeof(header));
+
+  std::vector<unsigned char> level(data, data + (size_t)width * height * 3);
+  stbi_image_free(data);
+
+  int levelWidth = width;
+  int levelHeight = height;
+  std::vector<unsigned char> tile((size_t)physicalSize * physicalSize * 3);
+  for (int l = 0; l < levels; l++) {
+    const int tilesX = std::max(1, levelWidth / tileSize);
+    const int tilesY = std::max(1, levelHeight / tileSize);
+    for (int ty = 0; ty < tilesY; ty++) {
+      for (int tx = 0; tx < tilesX; tx++) {
+        // The border repeats horizontally (the panorama wraps around the
+        // azimuth) and clamps at the poles.
+        for (int j = 0; j < physicalSize; j++) {
+          int y = ty * tileSize + j - border;
+          y = std::min(std::max(y, 0), levelHeight - 1);
+          for (int i = 0; i < physicalSize; i++) {
+            int x = tx * tileSize + i - border;
+            x = ((x % levelWidth) + levelWidth) % levelWidth;
+            memcpy(&tile[((size_t)j * physicalSize + i) * 3],
+                   &level[((size_t)y * levelWidth + x) * 3], 3);
+          }
+        }
+        ofs.write(reinterpret_cast<const char *>(tile.data()), tile.size());
+      }
+    }
+
+    // 2x2 box filter into the next level.
+    const int nextWidth = std::max(1, levelWidth / 2);
+    const int nextHeight = std::max(1, levelHeight / 2);
+    std::vector<unsigned char> next((size_t)nextWidth * nextHeight * 3);
+    for (int y = 0; y < nextHeight; y++) {
+      const int y0 = std::min(y * 2, levelHeight - 1);
+      const int y1 = std::min(y * 2 + 1, levelHeight - 1);
+      for (int x = 0; x < nextWidth; x++) {
+        const int x0 = std::min(x * 2, levelWidth - 1);
+        const int x1 = std::min(x * 2 + 1, levelWidth - 1);
+        for (int c = 0; c < 3; c++) {
+          int sum = level[((size_t)y0 * levelWidth + x0) * 3 + c] +
+                    level[((size_t)y0 * levelWidth + x1) * 3 + c] +
+                    level[((size_t)y1 * levelWidth + x0) * 3 + c] +
+                    level[((size_t)y1 * levelWidth + x1) * 3 + c];
+          next[((size_t)y * nextWidth + x) * 3 + c] = (sum + 2) / 4;
+        }
+      }
+    }
+    level.swap(next);
+    levelWidth = nextWidth;
+    levelHeight = nextHeight;
+  }
+
+  std::cout << "Wrote virtual texture " << vtFile << " (" << width << "x"
+            << height << ", " << levels << " levels)" << std::endl;
+  return true;
+}
+
+VirtualTexture::VirtualTexture(const std::string &vtFile,
+                               int cacheTilesPerSide)
+    : file(vtFile), physicalTilesPerSide(cacheTilesPerSide) {
+  std::ifstream ifs(vtFile, std::ios::in | std::ios::binary);
+  if (!ifs.is_open() ||
+      !ifs.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      memcmp(header.magic, VT_MAGIC, 4) != 0 || header.version != VT_VERSION ||
+      header.tileSize == 0 ||
+      (int)header.levels !=
+          countLevels(header.width, header.height, header.tileSize)) {
+    std::cout << "ERROR: Failed to load virtual texture at: " << vtFile
+              << std::endl;
+    return;
+  }
+
+  // Page table entries and feedback texels store tile coordinates in 8-bit
+  // and half-float channels respectively.
+  if (physicalTilesPerSide > 255 || tilesX(0) > 2048 || tilesY(0) > 2048) {
+    std::cout << "ERROR: Virtual texture " << vtFile << " is too large"
+              << std::endl;
+    return;
+  }
+
+  std::streamoff offset = sizeof(Header);
+  for (int l = 0; l < (int)header.levels; l++) {
+    levelOffsets.push_back(offset);
+    offset += (std::streamoff)tilesX(l) * tilesY(l) * tileBytes();
+  }
+
+  // Page table: one texel per tile, one mip level per pyramid level.
+  glGenTextures(1, &pageTableTexture);
+  glBindTexture(GL_TEXTURE_2D, pageTableTexture);
+  for (int l = 0; l < (int)header.levels; l++) {
+    glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA8, tilesX(l), tilesY(l), 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, NULL);
+  }
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header.levels - 1);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                  GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+  // Physical atlas: fixed size, tiles carry their own filtering border.
+  const int atlasSize = physicalTilesPerSide * (header.tileSize + 2 * header.border);
+  glGenTextures(1, &physicalTexture);
+  glBindTexture(GL_TEXTURE_2D, physicalTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB8, atlasSize, atlasSize, 0, GL_RGB,
+               GL_UNSIGNED_BYTE, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  slotOwners.assign(physicalTilesPerSide * physicalTilesPerSide, VT_NO_TILE);
+
+  // The coarsest level is loaded up front and never evicted so every lookup
+  // has a resident fallback.
+  const int top = header.levels - 1;
+  for (int y = 0; y < tilesY(top); y++) {
+    for (int x = 0; x < tilesX(top); x++) {
+      LoadedTile tile;
+      tile.key = tileKey(top, x, y);
+      if (!readTile(ifs, tile.key, tile.texels)) {
+        std::cout << "ERROR: Virtual texture " << vtFile << " is truncated"
+                  << std::endl;
+        return;
+      }
+      uploadTile(tile);
+    }
+  }
+  rebuildPageTable();
+
+  valid = true;
+  streamingThread = std::thread(&VirtualTexture::streamingThreadFunc, this);
+
+  std::cout << "Loaded virtual texture " << vtFile << " (" << header.width
+            << "x" << header.height << ", " << header.levels << " levels)"
+            << std::endl;
+}
+
+VirtualTexture::~VirtualTexture() {
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    stopStreaming = true;
+  }
+  queueCondition.notify_all();
+  if (streamingThread.joinable()) {
+    streamingThread.join();
+  }
+
+  glDeleteBuffers(2, readbackBuffers);
+  glDeleteTextures(1, &pageTableTexture);
+  glDeleteTextures(1, &physicalTexture);
+}
+
+uint64_t VirtualTexture::tileKey(int level, int x, int y) {
+  return ((uint64_t)level << 48) | ((uint64_t)y << 24) | (uint64_t)x;
+}
+
+int VirtualTexture::tilesX(int level) const {
+  return std::max(1u, (header.width >> level) / header.tileSize);
+}
+
+int VirtualTexture::tilesY(int level) const {
+  return std::max(1u, (header.height >> level) / header.tileSize);
+}
+
+size_t VirtualTexture::tileBytes() const {
+  const size_t physicalSize = header.tileSize + 2 * header.border;
+  return physicalSize * physicalSize * 3;
+}
+
+std::streamoff VirtualTexture::tileOffset(int level, int x, int y) const {
+  return levelOffsets[level] +
+         ((std::streamoff)y * tilesX(level) + x) * tileBytes();
+}
+
+bool VirtualTexture::readTile(std::ifstream &ifs, uint64_t key,
+                              std::vector<unsigned char> &texels) const {
+  const int level = (int)(key >> 48);
+  const int y = (int)((key >> 24) & 0xffffff);
+  const int x = (int)(key & 0xffffff);
+
+  texels.resize(tileBytes());
+  ifs.clear();
+  ifs.seekg(tileOffset(level, x, y));
+  return (bool)ifs.read(reinterpret_cast<char *>(texels.data()),
+                        texels.size());
+}
+
+void VirtualTexture::streamingThreadFunc() {
+  registerPerfCounterThread("vtStreaming");
+  std::ifstream ifs(file, std::ios::in | std::ios::binary);
+
+  while (true) {
+    uint64_t key;
+    {
+      std::unique_lock<std::mutex> lock(queueMutex);
+      queueCondition.wait(
+          lock, [this] { return stopStreaming || !requestQueue.empty(); });
+      if (stopStreaming) {
+        return;
+      }
+      key = requestQueue.front();
+      requestQueue.pop_front();
+    }
+
+    LoadedTile tile;
+    tile.key = key;
+    if (!readTile(ifs, key, tile.texels)) {
+      tile.texels.clear();
+    }
+
+    std::lock_guard<std::mutex> lock(queueMutex);
+    completedQueue.push_back(std::move(tile));
+  }
+}
+
+void VirtualTexture::requestTile(uint64_t key) {
+  if (pendingTiles.count(key)) {
+    return;
+  }
+  pendingTiles.insert(key);
+  requestQueue.push_back(key);
+}
+
+void VirtualTexture::processFeedback(GLuint feedbackTexture, int width,
+                                     int height) {
+  if (!valid) {
+    return;
+  }
+  frame++;
+
+  // Queue this frame's readback into one buffer while the other one, filled
+  // on the previous call, is mapped. The GPU has had a whole frame to finish
+  // it, so the map does not stall.
+  GLuint &writeBuffer = readbackBuffers[readbackIndex];
+  if (!writeBuffer) {
+    glGenBuffers(1, &writeBuffer);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, writeBuffer);
+  if (readbackSizes[readbackIndex][0] != width ||
+      readbackSizes[readbackIndex][1] != height) {
+    glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 3 * 4,
+                 NULL, GL_STREAM_READ);
+    readbackSizes[readbackIndex][0] = width;
+    readbackSizes[readbackIndex][1] = height;
+  }
+  glBindTexture(GL_TEXTURE_2D, feedbackTexture);
+  glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, (void *)0);
+
+  readbackIndex = 1 - readbackIndex;
+  GLuint readBuffer = readbackBuffers[readbackIndex];
+  const int readSize = readbackSizes[readbackIndex][0] *
+                       readbackSizes[readbackIndex][1];
+  if (!readBuffer || readSize == 0) {
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return;
+  }
+
+  std::unordered_set<uint64_t> requests;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, readBuffer);
+  const float *texels =
+      (const float *)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+  if (texels) {
+    for (int i = 0; i < readSize; i++) {
+      const int level = (int)std::lround(texels[i * 3 + 2]) - 1;
+      if (level < 0 || level >= (int)header.levels) {
+        continue;
+      }
+      const int x = (int)std::lround(texels[i * 3 + 0]);
+      const int y = (int)std::lround(texels[i * 3 + 1]);
+      if (x < 0 || y < 0 || x >= tilesX(level) || y >= tilesY(level)) {
+        continue;
+      }
+      requests.insert(tileKey(level, x, y));
+    }
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  // Coarse tiles first: they fix the largest screen areas and become the
+  // fallback for their children.
+  std::vector<uint64_t> missing;
+  for (uint64_t key : requests) {
+    auto it = residentTiles.find(key);
+    if (it != residentTiles.end()) {
+      it->second.lastUsedFrame = frame;
+      continue;
+    }
+    missing.push_back(key);
+
+    // Keep the ancestor currently standing in for this tile alive.
+    int level = (int)(key >> 48);
+    int y = (int)((key >> 24) & 0xffffff);
+    int x = (int)(key & 0xffffff);
+    while (++level < (int)header.levels) {
+      x >>= 1;
+      y >>= 1;
+      auto parent = residentTiles.find(tileKey(level, x, y));
+      if (parent != residentTiles.end()) {
+        parent->second.lastUsedFrame = frame;
+        break;
+      }
+    }
+  }
+  std::sort(missing.begin(), missing.end(), std::greater<uint64_t>());
+
+  {
+    // Requests that were not picked up yet are stale: the view has moved on.
+    std::lock_guard<std::mutex> lock(queueMutex);
+    for (uint64_t key : requestQueue) {
+      pendingTiles.erase(key);
+    }
+    requestQueue.clear();
+    for (uint64_t key : missing) {
+      requestTile(key);
+    }
+  }
+  queueCondition.notify_one();
+}
+
+void VirtualTexture::uploadTile(const LoadedTile &tile) {
+  const int level = (int)(tile.key >> 48);
+  const bool pinned = level == (int)header.levels - 1;
+
+  // Pick a free slot, or evict the least recently used tile that was not
+  // touched by the current frame. Pinned tiles never age.
+  int slot = -1;
+  uint64_t oldest = frame;
+  for (int i = 0; i < (int)slotOwners.size(); i++) {
+    if (slotOwners[i] == VT_NO_TILE) {
+      slot = i;
+      break;
+    }
+    const ResidentTile &resident = residentTiles.at(slotOwners[i]);
+    if (resident.lastUsedFrame < oldest) {
+      oldest = resident.lastUsedFrame;
+      slot = i;
+    }
+  }
+  if (slot < 0) {
+    return;
+  }
+  if (slotOwners[slot] != VT_NO_TILE) {
+    residentTiles.erase(slotOwners[slot]);
+  }
+
+  const int physicalSize = header.tileSize + 2 * header.border;
+  glBindTexture(GL_TEXTURE_2D, physicalTexture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % physicalTilesPerSide) * physicalSize,
+                  (slot / physicalTilesPerSide) * physicalSize, physicalSize,
+                  physicalSize, GL_RGB, GL_UNSIGNED_BYTE, tile.texels.data());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  markTextureModified(physicalTexture);
+
+  slotOwners[slot] = tile.key;
+  residentTiles[tile.key] = {slot, pinned ? ~0ull : frame};
+  pageTableDirty = true;
+}
+
+void VirtualTexture::update(int maxUploadsPerFrame) {
+  if (!valid) {
+    return;
+  }
+
+  std::vector<LoadedTile> uploads;
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    while (!completedQueue.empty() && (int)uploads.size() < maxUploadsPerFrame) {
+      uploads.push_back(std::move(completedQueue.front()));
+      completedQueue.pop_front();
+    }
+  }
+
+  for (const LoadedTile &tile : uploads) {
+    pendingTiles.erase(tile.key);
+    if (!tile.texels.empty()) {
+      uploadTile(tile);
+    }
+  }
+
+  if (pageTableDirty) {
+    rebuildPageTable();
+  }
+}
+
+void VirtualTexture::rebuildPageTable() {
+  // Walk from the coarsest level down so that every non-resident tile can
+  // inherit the entry of its parent.
+  std::vector<std::vector<unsigned char>> entries(header.levels);
+  for (int l = header.levels - 1; l >= 0; l--) {
+    const int w = tilesX(l);
+    const int h = tilesY(l);
+    entries[l].resize((size_t)w * h * 4);
+    for (int y = 0; y < h; y++) {
+      for (int x = 0; x < w; x++) {
+        unsigned char *entry = &entries[l][((size_t)y * w + x) * 4];
+        auto it = residentTiles.find(tileKey(l, x, y));
+        if (it != residentTiles.end()) {
+          entry[0] = it->second.slot % physicalTilesPerSide;
+          entry[1] = it->second.slot / physicalTilesPerSide;
+          entry[2] = l;
+          entry[3] = 255;
+        } else if (l + 1 < (int)header.levels) {
+          const int px = std::min(x >> 1, tilesX(l + 1) - 1);
+          const int py = std::min(y >> 1, tilesY(l + 1) - 1);
+          memcpy(entry, &entries[l + 1][((size_t)py * tilesX(l + 1) + px) * 4],
+                 4);
+        } else {
+          memset(entry, 0, 4);
+        }
+      }
+    }
+  }
+
+  glBindTexture(GL_TEXTURE_2D, pageTableTexture);
+  for (int l = 0; l < (int)header.levels; l++) {
+    glTexSubImage2D(GL_TEXTURE_2D, l, 0, 0, tilesX(l), tilesY(l), GL_RGBA,
+                    GL_UNSIGNED_BYTE, entries[l].data());
+  }
+  markTextureModified(pageTableTexture);
+  pageTableDirty = false;
+}
+
+void VirtualTexture::setUniforms(RenderToTextureInfo &rtti) const {
+  rtti.textureUniforms["vtPageTable"] = pageTableTexture;
+  rtti.textureUniforms["vtPhysical"] = physicalTexture;
+  rtti.floatUniforms["panoramaEnabled"] = valid ? 1.0f : 0.0f;
+  rtti.floatUniforms["vtWidth"] = (float)header.width;
+  rtti.floatUniforms["vtHeight"] = (float)header.height;
+  rtti.floatUniforms["vtLevels"] = (float)header.levels;
+  rtti.floatUniforms["vtTileSize"] = (float)header.tileSize;
+  rtti.floatUniforms["vtBorder"] = (float)header.border;
+  rtti.floatUniforms["vtPhysicalTiles"] = (float)physicalTilesPerSide;
+  rtti.floatUniforms["vtFeedback"] = 0.0f;
+  rtti.floatUniforms["vtLodBias"] = 0.0f;
+}
@@ -0,0 +1,94 @@
+#include <work_counters.h>
+
+const char *const GpuWorkCounters::COUNTER_NAMES[COUNTER_COUNT] = {
+    "steps", "diskSamples", "capturedRays", "escapedRays", "bloomSamples"};
+
+GpuWorkCounters::~GpuWorkCounters() {
+  for (int i = 0; i < RING_SIZE; i++) {
+    if (fences[i]) {
+      glDeleteSync(fences[i]);
+    }
+  }
+  if (buffers[0]) {
+    glDeleteBuffers(RING_SIZE, buffers);
+  }
+}
+
+bool GpuWorkCounters::isSupported() {
+  return GLEW_ARB_shader_storage_buffer_object;
+}
+
+bool GpuWorkCounters::beginFrame() {
+  if (!buffers[0]) {
+    glGenBuffers(RING_SIZE, buffers);
+    for (GLuint buffer : buffers) {
+      glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+      glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(results), NULL,
+                   GL_DYNAMIC_READ);
+    }
+  }
+
+  // The slot is still in flight if its frame has not been read back yet.
+  counting = !fences[current] || collect(current, blocking);
+  if (!counting) {
+    return false;
+  }
+
+  const uint32_t zero[COUNTER_COUNT] = {};
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[current]);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), zero);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffers[current]);
+  return true;
+}
+
+void GpuWorkCounters::endFrame() {
+  if (counting) {
+    fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    current = (current + 1) % RING_SIZE;
+    counting = false;
+  }
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+
+  // Oldest first, so results arrive in frame order.
+  for (int i = 0; i < RING_SIZE; i++) {
+    const int slot = (current + i) % RING_SIZE;
+    if (fences[slot] && !collect(slot, false)) {
+      break;
+    }
+  }
+}
+
+void GpuWorkCounters::finish() {
+  for (int i = 0; i < RING_SIZE; i++) {
+    const int slot = (current + i) % RING_SIZE;
+    if (fences[slot]) {
+      collect(slot, true);
+    }
+  }
+}
+
+bool GpuWorkCounters::collect(int slot, bool wait) {
+  GLenum status;
+  do {
+    status = glClientWaitSync(fences[slot], wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                              wait ? 100000000 : 0);
+  } while (wait && status == GL_TIMEOUT_EXPIRED);
+  if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+    return false;
+  }
+  glDeleteSync(fences[slot]);
+  fences[slot] = 0;
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[slot]);
+  glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(results), results);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  if (onFrameResolved) {
+    std::map<std::string, double> counters;
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+      counters[COUNTER_NAMES[i]] = results[i];
+    }
+    onFrameResolved(counters);
+  }
+  return true;
+}